@@ -25,9 +25,11 @@
 #define ISFQT_H
 
 #include <QColor>
+#include <QIODevice>
 #include <QList>
 #include <QMap>
 #include <QMatrix>
+#include <QObject>
 #include <QPointF>
 #include <QRectF>
 #include <QSizeF>
@@ -41,6 +43,11 @@ namespace Isf
   class Drawing;
   class StreamData;
 
+  namespace Compress
+  {
+    class Base64Encoder;
+  }
+
 
 
   /**
@@ -63,6 +70,23 @@ namespace Isf
 
 
 
+  /**
+   * Compression levels used by the ISF writer.
+   *
+   * Higher levels produce smaller streams, but take longer to analyze
+   * the data to compress. The writers use CompressionNormal by default;
+   * CompressionBest is worth it when streams are archived, rather than
+   * written over and over.
+   */
+  enum CompressionLevel
+  {
+    CompressionFast = 0          ///< Compress points with a fixed Huffman table
+  , CompressionNormal            ///< Compress points with the Huffman table best suited to each stroke
+  , CompressionBest              ///< Compress points with whichever algorithm gives the smallest output
+  };
+
+
+
   /**
    * List of predefined packet properties.
    *
@@ -291,28 +315,163 @@ namespace Isf
 
 
 
+  /**
+   * @class Decoder
+   * @brief Reader of raw ISF data streams.
+   *
+   * Each decoder keeps its own parser state, and reuses it for every stream
+   * it reads. Different decoders can be used at the same time from different
+   * threads, but a single decoder must not be shared between threads.
+   *
+   * With lazy loading enabled, the points of the strokes are only
+   * decompressed when the drawing first needs them: the stroke count and
+   * attributes are available right away.
+   *
+   * @see Stream::reader()
+   */
+  class Decoder
+  {
+
+    public: // Public constructors
+                         Decoder();
+                        ~Decoder();
+
+    public: // Public methods
+      Drawing            decode( const QByteArray&, bool = false );
+      bool               lazyLoading() const;
+      void               setLazyLoading( bool );
+
+    private: // Private properties
+      /// Whether to leave the strokes compressed until they are needed
+      bool               lazyLoading_;
+      /// Parser state, reset for every stream
+      StreamData*        streamData_;
+
+    private:
+      Q_DISABLE_COPY( Decoder )
+  };
+
+
+
+  /**
+   * @class IncrementalDecoder
+   * @brief Reader of ISF data streams which arrive in pieces.
+   *
+   * Data is given to the decoder with feed() as soon as it is available, for
+   * example while it is being received from a socket. Every stroke is
+   * decoded and announced with strokeDecoded() as soon as its bytes arrive,
+   * without waiting for the rest of the stream.
+   *
+   * The strokes are announced by index rather than by pointer: a copy of the
+   * drawing taken while feeding detaches it on the next feed(), and pointers
+   * to its strokes would not be valid anymore.
+   *
+   * Any bytes after the end of the stream are ignored. Call reset() to read
+   * another stream.
+   *
+   * @see Decoder
+   */
+  class IncrementalDecoder : public QObject
+  {
+    Q_OBJECT
+
+    public: // Public constructors
+                         IncrementalDecoder( QObject* parent = 0 );
+                        ~IncrementalDecoder();
+
+    public: // Public methods
+      qint64             bytesMissing() const;
+      const Drawing&     drawing() const;
+      IsfError           error() const;
+      void               feed( const QByteArray& data );
+      bool               isFinished() const;
+      void               reset();
+
+    signals:
+      /// The stream is over, or could not be read
+      void               finished( Isf::IsfError error );
+      /// A stroke has been decoded and added to the drawing, at the given index
+      void               strokeDecoded( int index );
+
+    private: // Private methods
+      void               finish( IsfError error );
+
+    private: // Private properties
+      /// Drawing being read
+      Drawing*           drawing_;
+      /// Current state of the parser
+      int                state_;
+      /// Position within the buffered data where the stream ends
+      qint64             streamEnd_;
+      /// Parser state and buffered data
+      StreamData*        streamData_;
+
+    private:
+      Q_DISABLE_COPY( IncrementalDecoder )
+  };
+
+
+
+  /**
+   * @class Encoder
+   * @brief Writer of raw ISF data streams.
+   *
+   * Each encoder keeps its own writer state, and reuses it for every stream
+   * it writes. Different encoders can be used at the same time from different
+   * threads, but a single encoder must not be shared between threads.
+   *
+   * @see Stream::writer()
+   */
+  class Encoder
+  {
+
+    public: // Public constructors
+                         Encoder();
+                        ~Encoder();
+
+    public: // Public methods
+      QByteArray         encode( const Drawing&, bool = false, CompressionLevel = CompressionNormal );
+      bool               encode( const Drawing&, QIODevice&, bool = false, CompressionLevel = CompressionNormal );
+
+    private: // Private methods
+      qint64             prepare( const Drawing&, CompressionLevel );
+      static bool        writeToDevice( QIODevice&, const QByteArray&, Compress::Base64Encoder* );
+
+    private: // Private properties
+      /// Writer state, reset for every stream
+      StreamData*        streamData_;
+
+    private:
+      Q_DISABLE_COPY( Encoder )
+  };
+
+
+
   /**
    * @class Stream
    * @brief The main class of the library.
    *
    * This class contains the only methods you need to transform ISF data
    * into strokes or pictures, and from strokes to ISF data.
+   *
+   * All of its methods are reentrant: each call uses its own Decoder or
+   * Encoder.
    */
   class Stream
   {
 
     public: // Public static methods
 
-      static Drawing    &reader( const QByteArray&, bool = false );
-      static Drawing    &readerGif( const QByteArray&, bool = false );
-      static Drawing    &readerPng( const QByteArray&, bool = false );
+      static Drawing     reader( const QByteArray&, bool = false );
+      static Drawing     reader( QIODevice&, bool = false );
+      static QList<Drawing> readerBatch( const QList<QByteArray>&, bool = false );
+      static Drawing     readerGif( const QByteArray&, bool = false );
+      static Drawing     readerPng( const QByteArray&, bool = false );
       static bool        supportsGif();
-      static QByteArray  writer( const Drawing&, bool = false );
-      static QByteArray  writerGif( const Drawing&, bool = false );
-      static QByteArray  writerPng( const Drawing&, bool = false );
-
-    private: // Private static properties
-      static StreamData* streamData_;
+      static QByteArray  writer( const Drawing&, bool = false, CompressionLevel = CompressionNormal );
+      static bool        writer( const Drawing&, QIODevice&, bool = false, CompressionLevel = CompressionNormal );
+      static QByteArray  writerGif( const Drawing&, bool = false, CompressionLevel = CompressionNormal );
+      static QByteArray  writerPng( const Drawing&, bool = false, CompressionLevel = CompressionNormal );
   };
 
 }
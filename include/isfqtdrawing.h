@@ -32,6 +32,7 @@
 #include <QPaintDevice>
 #include <QUuid>
 #include <QPixmap>
+#include <QSharedDataPointer>
 
 
 // Forward declarations
@@ -46,6 +47,11 @@ namespace Isf
 
 
 
+  // Forward declarations
+  struct DrawingData;
+
+
+
   /**
    * @class Drawing
    * @brief This is a manipulable representation of an ISF stream.
@@ -54,12 +60,19 @@ namespace Isf
    * drawings. You can manipulate its contents, or create a new one and
    * fill it, then save it back to ISF format with the Isf::Stream methods.
    *
+   * Drawings are implicitly shared: copying one is cheap, and its strokes
+   * are only duplicated when one of the copies is changed. The stroke
+   * pointers obtained from a drawing belong to it, and after a copy is made
+   * they only stay valid until the drawing gets changed.
+   *
    * @see Isf::Stream
    * @author Adam Goossens (adam@kmess.org)
    * @author Valerio Pilo (valerio@kmess.org)
    */
   class Drawing
   {
+    friend class Decoder;
+    friend class IncrementalDecoder;
     friend class Stream;
     friend class TagsParser;
     friend class TagsWriter;
@@ -67,7 +80,10 @@ namespace Isf
     public: // public constructors
                                  Drawing();
                                  Drawing( const Drawing&  );
+                                 Drawing( Drawing&& );
                                 ~Drawing();
+      Drawing&                   operator =( const Drawing& );
+      Drawing&                   operator =( Drawing&& );
 
     public: // public state retrieval methods
       QRect                      boundingRect() const;
@@ -76,11 +92,12 @@ namespace Isf
       qint32                     indexOfStroke( const Stroke* ) const;
       bool                       isEmpty() const;
       bool                       isNull() const;
-      QPixmap                    pixmap( const QColor = Qt::transparent );
+      QPixmap                    pixmap( const QColor = Qt::transparent ) const;
       void                       setBoundingRect( QRect );
       QSize                      size() const;
       Stroke*                    stroke( quint32 );
       Stroke*                    strokeAtPoint( const QPoint& );
+      int                        strokeCount() const;
       const QList<Stroke*>       strokes();
 
     public: // public manipulation methods
@@ -93,34 +110,8 @@ namespace Isf
       void                       updateBoundingRect();
 
     private: // Private properties
-      /// Bounding rectangle of the drawing
-      QRect                      boundingRect_;
-      /// Cached bounding rectangle
-      QRect                      cacheRect_;
-      /// The cached pixmap
-      QPixmap                    cachePixmap_;
-      /// Virtual drawing canvas dimensions
-      QRect                      canvas_;
-      /// A list of strokes that need to be repainted.
-      QList<Stroke*>             changedStrokes_;
-      /// Is the drawing dirty? i.e, requires repainting?
-      bool                       dirty_;
-      /// Last parsing error (if there is one)
-      IsfError                   error_;
-      /// List of registered GUIDs
-      QList<QUuid>               guids_;
-      /// Whether the drawing contains X coordinates or not
-      bool                       hasXData_;
-      /// Whether the drawing contains Y coordinates or not
-      bool                       hasYData_;
-      /// Whether the drawing is invalid or valid
-      bool                       isNull_;
-      /// Maximum GUID available in the drawing
-      quint64                    maxGuid_;
-      /// Maximum thickness of the strokes
-      QSizeF                     maxPenSize_;
-      /// List of strokes composing this drawing
-      QList<Stroke*>             strokes_;
+      /// Implicitly shared drawing data
+      QSharedDataPointer<DrawingData> d_;
 
   };
 
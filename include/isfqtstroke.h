@@ -28,9 +28,13 @@
 
 #include <QColor>
 #include <QList>
+#include <QMap>
 #include <QMatrix>
 #include <QRect>
+#include <QSharedDataPointer>
+#include <QSharedPointer>
 #include <QSizeF>
+#include <QVector>
 
 
 // Forward declarations
@@ -45,65 +49,68 @@ namespace Isf
 
   // Forward declarations
   class AttributeSet;
+  struct StrokeData;
 
 
 
   /**
   * A pen stroke.
+  *
+  * The points are stored as separate arrays of X coordinates, Y coordinates and
+  * pressure levels, plus any other packet property as an extra channel.
+  *
+  * Stroke data is implicitly shared: copies are cheap, and the data gets
+  * duplicated only when one of the copies is changed.
+  *
+  * Since the points are not stored as a list anymore, points() returns a
+  * read-only copy of them, instead of a reference which could be changed.
+  * Code which changed the points through it does not compile anymore.
   */
   class Stroke
   {
     public:
       Stroke();
       Stroke( const Stroke& );
+      Stroke( Stroke&& );
      ~Stroke();
+      Stroke&       operator =( const Stroke& );
+      Stroke&       operator =( Stroke&& );
 
       void          addPoint(const Point& );
       void          addPoints(const PointList& );
+      void          addPoints( const QVector<qint32>&, const QVector<qint32>&, const QVector<qint64>& = QVector<qint64>() );
       QRect         boundingRect() const;
+      QVector<qint64> channel( PacketProperty ) const;
       QColor        color() const;
       void          finalize();
       StrokeFlags   flags() const;
       bool          hasPressureData() const;
-      Metrics*      metrics();
-      QPainterPath  painterPath();
+      Metrics*      metrics() const;
+      QPainterPath  painterPath() const;
       QSizeF        penSize() const;
-      PointList&    points();
+      int           pointCount() const;
+      const PointList points() const;
+      const QVector<qint64>& pressureLevels() const;
+      void          setChannel( PacketProperty, const QVector<qint64>& );
       void          setColor( QColor );
       void          setFlag( StrokeFlag, bool = true );
       void          setFlags( StrokeFlags );
       void          setMetrics( Metrics* );
+      void          setMetrics( const QSharedPointer<Metrics>& );
       void          setPenSize( QSizeF );
       void          setTransform( QMatrix* );
-      QMatrix*      transform();
+      void          setTransform( const QSharedPointer<QMatrix>& );
+      QMatrix*      transform() const;
+      const QVector<qint32>& xPositions() const;
+      const QVector<qint32>& yPositions() const;
 
     private:
-      void          bezierCalculateControlPoints();
-      void          bezierGetFirstControlPoints(const std::vector<double>&, std::vector<double>*, int );
+      void          bezierCalculateControlPoints() const;
+      void          bezierGetFirstControlPoints(const std::vector<double>&, std::vector<double>*, int ) const;
 
     private:
-      /// Bezier data
-      QList<QPointF> bezierControlPoints1_;
-      QList<QPointF> bezierControlPoints2_;
-      QList<QPointF> bezierKnots_;
-      /// Bounding rectangle of this stroke
-      QRect          boundingRect_;
-      /// The stroke color, optionally with alpha channel
-      QColor         color_;
-      /// Whether the stroke data needs to be analyzed or not
-      bool           finalized_;
-      /// Mask of StrokeFlags, @see StrokeFlags
-      StrokeFlags    flags_;
-      /// Whether the stroke contains pressure information or not
-      bool           hasPressureData_;
-      /// Link to this stroke's metrics, if any
-      Metrics*       metrics_;
-      /// Dimensions of the pencil in pixels
-      QSizeF         penSize_;
-      /// List of points
-      PointList      points_;
-      /// Link to this stroke's transformation, if any
-      QMatrix*       transform_;
+      /// Implicitly shared stroke data
+      QSharedDataPointer<StrokeData> d_;
 
 
   };
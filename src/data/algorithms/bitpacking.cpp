@@ -20,10 +20,18 @@
 
 #include "isfqt-internal.h"
 #include "bitpacking.h"
-
-#include <math.h>
+#include "bitpacking_table.h"
+#include "deltatransform.h"
+#include "valuewriter.h"
 
 #include <QDebug>
+#include <QtEndian>
+
+
+/// Bytes read by the unpacker for each value
+#define BITPACKING_READ_SIZE   9
+/// Number of values unpacked at once
+#define BITPACKING_BATCH_SIZE  256
 
 
 using namespace Isf::Compress;
@@ -34,21 +42,23 @@ using namespace Isf::Compress;
  * Get the most appropriate block size for the given data.
  *
  * @param data Data to analyze
+ * @param deltaTransform Whether to analyze the delta-delta transformed data
  * @return Block size
  */
-quint8 BitPackingAlgorithm::blockSize( const QList<qint64>& data )
+quint8 BitPackingAlgorithm::blockSize( const QList<qint64>& data, bool deltaTransform )
 {
   quint8 blockSize = 0;
   qint64 num;
+  Delta::State delta;
 
   for( qint32 index = 0; index < data.size(); ++index )
   {
-    num = data[ index ];
+    num = deltaTransform ? delta.transform( data[ index ] ) : data[ index ];
 
     if( num < 0 )
     {
       // We need the positive numbers: the +1 is for the sign bit
-      num += - (num + 1);
+      num = - ( num + 1 );
     }
 
     // Shift right the value by blockSize bits until it becomes zero:
@@ -76,9 +86,10 @@ quint8 BitPackingAlgorithm::blockSize( const QList<qint64>& data )
  * @param encodedData Byte array where to store the compressed data
  * @param blockSize Block size to use for compression
  * @param source List of values to compress
+ * @param deltaTransform Whether to delta-delta transform the values while compressing them
  * @return bool
  */
-bool BitPackingAlgorithm::deflate( QByteArray& encodedData, quint8 blockSize, const QList<qint64>& source )
+bool BitPackingAlgorithm::deflate( QByteArray& encodedData, quint8 blockSize, const QList<qint64>& source, bool deltaTransform )
 {
   if( blockSize > 64 )
   {
@@ -86,65 +97,112 @@ bool BitPackingAlgorithm::deflate( QByteArray& encodedData, quint8 blockSize, co
     blockSize = 64; // Fuck it :P
   }
 
-  quint8 blockSizeLeft; // Remaining bits to encode of the current value
-  quint8 freeBits = 8;  // Free bits of the current byte, in LSB order
-  quint8 signMask = 1 << ( blockSize - 1 );  // Mask to add the sign bit
+  if( blockSize == 0 || source.isEmpty() )
+  {
+    return true;
+  }
+
+  // Make room for all the values at once, then write them in place
+  int offset = encodedData.size();
+  encodedData.resize( offset + ( (quint64)blockSize * source.count() + 7 ) / 8 );
+
+  pack( source, blockSize, reinterpret_cast<uchar*>( encodedData.data() ) + offset, deltaTransform );
 
-  quint8 byte = 0;          // Byte to add to the array
-  qint64 currentValue;
+  return true;
+}
 
-  for( qint64 index = 0; index < source.count(); ++index )
+
+
+/**
+ * Read values stored as fixed size blocks of bits.
+ *
+ * When the data starts at a byte boundary, which it always does within
+ * ISF streams, values are unpacked straight from the source's byte array.
+ *
+ * @param source Data source where to read the compressed bytes
+ * @param length Number of items to read
+ * @param blockSize Block size to use for compression
+ * @param output QList or ValueWriter where to place decompressed values
+ * @param isSigned Whether the values are signed, and need their sign extended
+ * @param deltaTransform Whether to delta-delta inverse transform the values while decompressing them
+ */
+template<class Output>
+static void inflateValues( DataSource* source, quint64 length, quint8 blockSize, Output& output, bool isSigned, bool deltaTransform )
+{
+  const quint64 available = source->size() - source->pos();
+  const quint64 totalBytes = ( length * blockSize + 7 ) / 8;
+
+  Delta::State delta;
+
+  // Slow path, for data which doesn't start at a byte boundary and for
+  // truncated data, where the missing values are zero
+  if( blockSize == 0 || source->getBitIndex() != 8 || totalBytes > available )
   {
-    currentValue = source[ index ];
+    qint64  value;
+    quint64 index = 0;
+    quint8  shift = ( blockSize > 0 ) ? ( 64 - blockSize ) : 0;
 
-    if( currentValue < 0 )
+    while( index++ < length )
     {
-      currentValue |= signMask;
+      value = source->getBits( blockSize );
+
+      // Move the sign bit to the leftmost position, then back: the arithmetic
+      // shift sets all leftmost bits to the sign, making it a real 64bit
+      // signed integer
+      if( isSigned )
+      {
+        value = (qint64)( (quint64)value << shift ) >> shift;
+      }
+
+      output.append( deltaTransform ? delta.inverseTransform( value ) : value );
     }
 
-    blockSizeLeft = blockSize;
+    return;
+  }
 
-    if( freeBits >= blockSizeLeft )
-    {
-      freeBits -= blockSizeLeft;
-      byte |= currentValue << freeBits;
+  const uchar* input = reinterpret_cast<const uchar*>( source->data().constData() ) + source->pos();
 
-      encodedData.append( byte );
+  // Values can be read straight from the source as long as there are enough
+  // bytes after each of them for the unpacker's wide reads
+  quint64 safeLength = 0;
+  if( available >= BITPACKING_READ_SIZE )
+  {
+    safeLength = qMin( length, ( ( available - BITPACKING_READ_SIZE ) * 8 ) / blockSize + 1 );
+  }
 
-      byte = 0;
-      freeBits = 8;
-    }
-    else
-    {
-      // Fill the current byte
-      quint64 mask = 0xFFFFFFFF >> ( 32 - blockSizeLeft );
-      byte |= currentValue >> ( blockSizeLeft - freeBits );
+  // Unpack the values in small batches, so that the buffer stays in the cache
+  qint64 values[ BITPACKING_BATCH_SIZE ];
 
-      encodedData.append( byte );
+  for( quint64 index = 0; index < safeLength; index += BITPACKING_BATCH_SIZE )
+  {
+    quint64 count = qMin<quint64>( BITPACKING_BATCH_SIZE, safeLength - index );
 
-      byte = 0;
-      blockSizeLeft -= freeBits;
-      mask >>= freeBits;
-      currentValue &= mask;
+    BitPackingAlgorithm::unpack( input, index * blockSize, count, blockSize, values, isSigned );
 
-      // Then fill all the next bytes required to encode the current value,
-      // except the last one
-      while( blockSizeLeft > 8 )
-      {
-        blockSizeLeft -= 8;
-        encodedData.append( currentValue >> blockSizeLeft );
+    for( quint64 i = 0; i < count; ++i )
+    {
+      output.append( deltaTransform ? delta.inverseTransform( values[ i ] ) : values[ i ] );
+    }
+  }
 
-        mask >>= 8;
-        currentValue &= mask;
-      }
+  // Copy the last few bytes in a padded buffer to unpack the remaining values
+  if( safeLength < length )
+  {
+    uchar   tail[ 2 * BITPACKING_READ_SIZE + 8 ] = { 0 };
+    quint64 firstBit  = safeLength * blockSize;
+    quint64 firstByte = firstBit / 8;
+
+    memcpy( tail, input + firstByte, totalBytes - firstByte );
 
-      // Finally, add the last byte
-      freeBits = 8 - blockSizeLeft;
-      encodedData.append( currentValue << freeBits );
+    BitPackingAlgorithm::unpack( tail, firstBit % 8, length - safeLength, blockSize, values, isSigned );
+
+    for( quint64 i = 0; i < length - safeLength; ++i )
+    {
+      output.append( deltaTransform ? delta.inverseTransform( values[ i ] ) : values[ i ] );
     }
   }
 
-  return true;
+  source->seekRelative( (int)totalBytes );
 }
 
 
@@ -156,9 +214,76 @@ bool BitPackingAlgorithm::deflate( QByteArray& encodedData, quint8 blockSize, co
  * @param length Number of items to read
  * @param blockSize Block size to use for compression
  * @param decodedData List where to place decompressed values
+ * @param isSigned Whether the values are signed, and need their sign extended
+ * @param deltaTransform Whether to delta-delta inverse transform the values while decompressing them
+ * @return bool
+ */
+bool BitPackingAlgorithm::inflate( DataSource* source, quint64 length, quint8 blockSize, QList<qint64>& decodedData, bool isSigned, bool deltaTransform )
+{
+  if( blockSize > 64 )
+  {
+    qWarning() << "A block size of" << blockSize << "is too high!";
+    blockSize = 64; // Fuck it :P
+  }
+
+  if( source->atEnd() )
+  {
+    qWarning() << "Cannot inflate: no more bits available!";
+    return true;
+  }
+
+  decodedData.reserve( decodedData.size() + length );
+
+  inflateValues( source, length, blockSize, decodedData, isSigned, deltaTransform );
+  return true;
+}
+
+
+
+/**
+ * Decompress data with the Bit Packing algorithm, into an array of 32 bits values.
+ *
+ * @param source Data source where to read the compressed bytes
+ * @param length Number of items to read
+ * @param blockSize Block size to use for compression
+ * @param decodedData Array where to place decompressed values, with room for [length] values
+ * @param isSigned Whether the values are signed, and need their sign extended
+ * @param deltaTransform Whether to delta-delta inverse transform the values while decompressing them
+ * @return bool
+ */
+bool BitPackingAlgorithm::inflate( DataSource* source, quint64 length, quint8 blockSize, qint32* decodedData, bool isSigned, bool deltaTransform )
+{
+  if( blockSize > 64 )
+  {
+    qWarning() << "A block size of" << blockSize << "is too high!";
+    blockSize = 64; // Fuck it :P
+  }
+
+  if( source->atEnd() )
+  {
+    qWarning() << "Cannot inflate: no more bits available!";
+    return true;
+  }
+
+  ValueWriter<qint32> output( decodedData );
+  inflateValues( source, length, blockSize, output, isSigned, deltaTransform );
+  return true;
+}
+
+
+
+/**
+ * Decompress data with the Bit Packing algorithm, into an array of 64 bits values.
+ *
+ * @param source Data source where to read the compressed bytes
+ * @param length Number of items to read
+ * @param blockSize Block size to use for compression
+ * @param decodedData Array where to place decompressed values, with room for [length] values
+ * @param isSigned Whether the values are signed, and need their sign extended
+ * @param deltaTransform Whether to delta-delta inverse transform the values while decompressing them
  * @return bool
  */
-bool BitPackingAlgorithm::inflate( DataSource* source, quint64 length, quint8 blockSize, QList<qint64>& decodedData )
+bool BitPackingAlgorithm::inflate( DataSource* source, quint64 length, quint8 blockSize, qint64* decodedData, bool isSigned, bool deltaTransform )
 {
   if( blockSize > 64 )
   {
@@ -172,25 +297,140 @@ bool BitPackingAlgorithm::inflate( DataSource* source, quint64 length, quint8 bl
     return true;
   }
 
-  qint64  value;
-  quint32 index    = 0;
-  quint64 signMask = (quint64)( 0xFFFFFFFF * pow( 2, blockSize - 1 ) ) & 0xFFFFFFFF;
+  ValueWriter<qint64> output( decodedData );
+  inflateValues( source, length, blockSize, output, isSigned, deltaTransform );
+  return true;
+}
+
+
+
+/**
+ * Write values as fixed size blocks of bits.
+ *
+ * Values are truncated to [blockSize] bits, so negative values are
+ * stored in two's complement. The bits are gathered in a 64-bit word,
+ * which is written out whole as soon as it gets filled.
+ *
+ * @param source List of values to write
+ * @param blockSize Number of bits of each value, from 1 to 64
+ * @param output Buffer where to write, big enough to hold all the values
+ * @param deltaTransform Whether to delta-delta transform the values while writing them
+ */
+void BitPackingAlgorithm::pack( const QList<qint64>& source, quint8 blockSize, uchar* output, bool deltaTransform )
+{
+  quint64 word     = 0;
+  quint8  wordSize = 0;
+  Delta::State delta;
+
+  foreach( qint64 value, source )
+  {
+    if( deltaTransform )
+    {
+      value = delta.transform( value );
+    }
+
+    // Align the value to the left, dropping the bits over the block size
+    quint64 bits = (quint64)value << ( 64 - blockSize );
+
+    word     |= bits >> wordSize;
+    wordSize += blockSize;
+
+    if( wordSize >= 64 )
+    {
+      qToBigEndian( word, output );
+      output += 8;
 
-  while( index++ < length )
+      // Keep the bits of the value which did not fit
+      wordSize -= 64;
+      word = ( wordSize > 0 ) ? ( bits << ( blockSize - wordSize ) ) : 0;
+    }
+  }
+
+  // Write the last partial word
+  for( quint8 shift = 56; wordSize > 0; shift -= 8 )
   {
-    value = source->getBits( blockSize );
+    *output++ = word >> shift;
+    wordSize  = ( wordSize > 8 ) ? ( wordSize - 8 ) : 0;
+  }
+}
+
+
 
-    // If the mask matches, the sign bit is set, so ORing value and mask will
-    // set all leftmost bits to 1, making it a real 64bit signed integer
-    if( value & signMask )
+/**
+ * Find the bit lookup table entry for the given number of values.
+ *
+ * The entries of the table are meant for the bit packing of property data:
+ * besides the block size, they specify how many padding values follow the
+ * real ones to fill up the last byte.
+ *
+ * @param cBits Block size
+ * @param count Number of values to store
+ * @return Index of the entry, or 0 if none matches
+ */
+quint8 BitPackingAlgorithm::tableIndex( quint8 cBits, quint64 count )
+{
+  quint64 totalBits = ( ( count * cBits + 7 ) / 8 ) * 8;
+  quint8  cPads     = totalBits / cBits - count;
+
+  for( quint8 index = 1; index < 48; ++index )
+  {
+    if( bitLookUpTable_[ index ][ CBITS ] == cBits && bitLookUpTable_[ index ][ CPADS ] == cPads )
     {
-      value |= signMask;
+      return index;
     }
+  }
+
+  return 0;
+}
+
 
-    decodedData.append( value );
+
+/**
+ * Read values stored as fixed size blocks of bits.
+ *
+ * Each value is read with one or two unaligned 64-bit loads, and then
+ * moved into place, and sign-extended if needed, with a couple of shifts. There are no
+ * branches and no dependencies between iterations, which lets the compiler
+ * vectorize the loops.
+ *
+ * The input buffer must be readable for BITPACKING_READ_SIZE bytes after
+ * the start of the last value.
+ *
+ * @param input Buffer to read from
+ * @param firstBit Position of the first value within the buffer, in bits
+ * @param length Number of values to read
+ * @param blockSize Number of bits of each value, from 1 to 64
+ * @param output Array where to place the values
+ * @param isSigned Whether the values are signed, and need their sign extended
+ */
+void BitPackingAlgorithm::unpack( const uchar* input, quint64 firstBit, quint64 length, quint8 blockSize, qint64* output, bool isSigned )
+{
+  const quint8 shift = 64 - blockSize;
+
+  if( blockSize <= 57 )
+  {
+    // A value never spans more than 8 bytes
+    for( quint64 index = 0; index < length; ++index )
+    {
+      quint64 bit  = firstBit + index * blockSize;
+      quint64 word = qFromBigEndian<quint64>( input + ( bit >> 3 ) ) << ( bit & 7 );
+
+      output[ index ] = isSigned ? ( (qint64)word >> shift ) : (qint64)( word >> shift );
+    }
   }
+  else
+  {
+    // Values may have some bits in a ninth byte
+    for( quint64 index = 0; index < length; ++index )
+    {
+      quint64 bit  = firstBit + index * blockSize;
+      quint64 word = ( qFromBigEndian<quint64>( input + ( bit >> 3 ) ) << ( bit & 7 ) )
+                   | ( ( (quint64)input[ ( bit >> 3 ) + 8 ] << ( bit & 7 ) ) >> 8 );
 
-  return true;
+      output[ index ] = isSigned ? ( (qint64)word >> shift ) : (qint64)( word >> shift );
+    }
+  }
 }
 
 
+
@@ -32,9 +32,17 @@ namespace Isf
     namespace BitPackingAlgorithm
     {
 
-      quint8 blockSize( const QList<qint64>& data );
-      bool deflate( QByteArray& encodedData, quint8 blockSize, const QList<qint64>& source );
-      bool inflate( DataSource* source, quint64 length, quint8 blockSize, QList<qint64>& decodedData );
+      quint8 blockSize( const QList<qint64>& data, bool deltaTransform = false );
+      bool deflate( QByteArray& encodedData, quint8 blockSize, const QList<qint64>& source, bool deltaTransform = false );
+      bool inflate( DataSource* source, quint64 length, quint8 blockSize, QList<qint64>& decodedData, bool isSigned = true, bool deltaTransform = false );
+      bool inflate( DataSource* source, quint64 length, quint8 blockSize, qint32* decodedData, bool isSigned = true, bool deltaTransform = false );
+      bool inflate( DataSource* source, quint64 length, quint8 blockSize, qint64* decodedData, bool isSigned = true, bool deltaTransform = false );
+
+      // Internal use methods
+
+      void   pack( const QList<qint64>& source, quint8 blockSize, uchar* output, bool deltaTransform = false );
+      quint8 tableIndex( quint8 cBits, quint64 count );
+      void   unpack( const uchar* input, quint64 firstBit, quint64 length, quint8 blockSize, qint64* output, bool isSigned );
 
     }
   }
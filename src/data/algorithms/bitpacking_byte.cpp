@@ -20,9 +20,18 @@
 
 #include "isfqt-internal.h"
 #include "bitpacking_byte.h"
+#include "bitpacking.h"
 #include "bitpacking_table.h"
 
 
+/// Block size of uncompressed bytes
+#define BYTE_BITS  8
+/// Highest index of the bit lookup table usable for bytes
+#define BYTE_MAX_INDEX  24
+/// Number of values expanded at once
+#define BYTE_BATCH_SIZE  256
+
+
 using namespace Isf::Compress;
 
 
@@ -30,48 +39,40 @@ using namespace Isf::Compress;
 /**
  * Get the most appropriate index for the given data.
  *
+ * Index 0 stores the bytes whole; the other indices refer to the bit
+ * lookup table.
+ *
  * @param data Data to analyze
  * @return Index value
  */
 quint8 BitPackingByteAlgorithm::index( const QList<qint64>& data )
 {
-  Q_UNUSED( data );
-
-  quint8 index = 0;
-/*
-  qint64 num;
+  quint64 allBits = 0;
 
-  for( qint32 index = 0; index < data.size(); ++index )
+  foreach( qint64 value, data )
   {
-    num = data[ index ];
+    allBits |= value;
+  }
 
-    if( num < 0 )
-    {
-      // We need the positive numbers: the +1 is for the sign bit
-      num += - (num + 1);
-    }
+  // Find the number of bits needed to store the biggest value
+  quint8 cBits = 1;
+  while( allBits >> cBits )
+  {
+    ++cBits;
+  }
 
-    // Shift right the value by index bits until it becomes zero:
-    // we need to detect the maximum bitwise size required to store
-    // the numbers in the data array.
-    num >>= index;
-    while( num )
-    {
-      ++index;
-      num >>= 1;
-    }
+  if( cBits >= BYTE_BITS )
+  {
+    return 0;
   }
 
-  // The sign bit always takes up a bit
-  ++index;
-*/
-  return index;
+  return BitPackingAlgorithm::tableIndex( cBits, data.count() );
 }
 
 
 
 /**
- * Compress data with the Bit Packing algorithm.
+ * Compress data with the Bit Packing Byte algorithm.
  *
  * @param encodedData Byte array where to store the compressed data
  * @param index Index to use for compression
@@ -80,76 +81,27 @@ quint8 BitPackingByteAlgorithm::index( const QList<qint64>& data )
  */
 bool BitPackingByteAlgorithm::deflate( QByteArray& encodedData, quint8 index, const QList<qint64>& source )
 {
-  Q_UNUSED( encodedData );
-  Q_UNUSED( index );
-  Q_UNUSED( source );
-
-/*
-  if( blockSize > 64 )
+  if( index > BYTE_MAX_INDEX )
   {
-    qWarning() << "A block size of" << blockSize << "is too high!";
-    blockSize = 64; // Fuck it :P
+    qWarning() << "An index of" << index << "is too high!";
+    return false;
   }
 
-  quint8 blockSizeLeft; // Remaining bits to encode of the current value
-  quint8 freeBits = 8;  // Free bits of the current byte, in LSB order
-  quint8 signMask = 1 << ( blockSize - 1 );  // Mask to add the sign bit
-
-  quint8 byte = 0;          // Byte to add to the array
-  qint64 currentValue;
+  quint8 cBits = BitPackingAlgorithm::bitLookUpTable_[ index ][ CBITS ];
 
-  for( qint64 index = 0; index < source.count(); ++index )
+  foreach( qint64 value, source )
   {
-    currentValue = source[ index ];
-
-    if( currentValue < 0 )
-    {
-      currentValue |= signMask;
-    }
-
-    blockSizeLeft = blockSize;
-
-    if( freeBits >= blockSizeLeft )
-    {
-      freeBits -= blockSizeLeft;
-      byte |= currentValue << freeBits;
-
-      encodedData.append( byte );
-
-      byte = 0;
-      freeBits = 8;
-    }
-    else
+    if( value < 0 || ( value >> cBits ) != 0 )
     {
-      // Fill the current byte
-      quint64 mask = 0xFFFFFFFF >> ( 32 - blockSizeLeft );
-      byte |= currentValue >> ( blockSizeLeft - freeBits );
-
-      encodedData.append( byte );
-
-      byte = 0;
-      blockSizeLeft -= freeBits;
-      mask >>= freeBits;
-      currentValue &= mask;
-
-      // Then fill all the next bytes required to encode the current value,
-      // except the last one
-      while( blockSizeLeft > 8 )
-      {
-        blockSizeLeft -= 8;
-        encodedData.append( currentValue >> blockSizeLeft );
-
-        mask >>= 8;
-        currentValue &= mask;
-      }
-
-      // Finally, add the last byte
-      freeBits = 8 - blockSizeLeft;
-      encodedData.append( currentValue << freeBits );
+#ifdef ISFQT_DEBUG
+      qDebug() << "Value" << value << "does not fit in" << cBits << "bits!";
+#endif
+      return false;
     }
   }
-*/
-  return true;
+
+  // The padding values are all zero bits, which the last byte already has
+  return BitPackingAlgorithm::deflate( encodedData, cBits, source );
 }
 
 
@@ -157,18 +109,21 @@ bool BitPackingByteAlgorithm::deflate( QByteArray& encodedData, quint8 index, co
 /**
  * Decompress data with the Bit Packing Byte algorithm.
  *
+ * Values of 1, 2, 4 and 8 bits never cross a byte boundary: these are
+ * expanded straight from the source's byte array.
+ *
  * @param source Data source where to read the compressed bytes
- * @param length Number of items to read
+ * @param length Number of bytes to read
  * @param index Index to use for compression
  * @param decodedData List where to place decompressed values
  * @return bool
  */
 bool BitPackingByteAlgorithm::inflate( DataSource* source, quint64 length, quint8 index, QList<qint64>& decodedData )
 {
-  if( index > 24 )
+  if( index > BYTE_MAX_INDEX )
   {
     qWarning() << "An index of" << index << "is too high!";
-    index = 24; // Fuck it :P
+    index = BYTE_MAX_INDEX; // Fuck it :P
   }
 
   if( source->atEnd() )
@@ -178,25 +133,81 @@ bool BitPackingByteAlgorithm::inflate( DataSource* source, quint64 length, quint
   }
 
   quint8 cBits = BitPackingAlgorithm::bitLookUpTable_[ index ][ CBITS ];
-//   quint8 cPads = BitPackingAlgorithm::bitLookUpTable_[ index ][ CPADS ];
-  quint16 count = ( length * 8 / cBits ); // Number of items in the compressed array
+  quint8 cPads = BitPackingAlgorithm::bitLookUpTable_[ index ][ CPADS ];
 
-  bool ok;
-  quint64 pos = 0;
-  while( pos++ < count )
+  // Number of items in the compressed array
+  quint64 count = length * 8 / cBits;
+
+  if( count < cPads )
+  {
+    qWarning() << "Decompression failure!";
+    return false;
+  }
+
+  count -= cPads;
+
+  const quint64 totalBytes = ( count * cBits + 7 ) / 8;
+
+  if( ( BYTE_BITS % cBits ) != 0
+  ||  source->getBitIndex() != 8
+  ||  totalBytes > (quint64)( source->size() - source->pos() ) )
   {
-    quint8 byte = source->getBits( cBits, &ok );
+    return BitPackingAlgorithm::inflate( source, count, cBits, decodedData, false /* isSigned */ );
+  }
+
+  const uchar* input = reinterpret_cast<const uchar*>( source->data().constData() ) + source->pos();
 
-    if( ! ok )
+  // Expand the values in small batches, so that the buffer stays in the cache
+  qint64 values[ BYTE_BATCH_SIZE ];
+
+  decodedData.reserve( decodedData.size() + count );
+
+  for( quint64 first = 0; first < count; first += BYTE_BATCH_SIZE )
+  {
+    quint64 batchSize = qMin<quint64>( BYTE_BATCH_SIZE, count - first );
+
+    // Batches always start at a byte boundary
+    expand( input + ( first * cBits ) / 8, batchSize, cBits, values );
+
+    for( quint64 i = 0; i < batchSize; ++i )
     {
-      qWarning() << "Decompression failure!";
-      return false;
+      decodedData.append( values[ i ] );
     }
-
-    decodedData.append( byte );
   }
 
+  source->seekRelative( (int)totalBytes );
+
   return true;
 }
 
 
+
+/**
+ * Read values of 1, 2, 4 or 8 bits.
+ *
+ * Every value is in the byte at its index divided by the number of values
+ * per byte, so it can be read with a single shift and mask. There are no
+ * branches and no dependencies between iterations, which lets the compiler
+ * vectorize the loop.
+ *
+ * @param input Buffer to read from
+ * @param length Number of values to read
+ * @param cBits Number of bits of each value: 1, 2, 4 or 8
+ * @param output Array where to place the values
+ */
+void BitPackingByteAlgorithm::expand( const uchar* input, quint64 length, quint8 cBits, qint64* output )
+{
+  // Values per byte, as a power of two
+  const quint8 perByteShift = ( cBits == 1 ) ? 3 : ( cBits == 2 ) ? 2 : ( cBits == 4 ) ? 1 : 0;
+  const quint8 perByteMask  = ( 1 << perByteShift ) - 1;
+  const uchar  valueMask    = ( 1 << cBits ) - 1;
+
+  for( quint64 index = 0; index < length; ++index )
+  {
+    quint8 shift = BYTE_BITS - cBits - ( index & perByteMask ) * cBits;
+
+    output[ index ] = ( input[ index >> perByteShift ] >> shift ) & valueMask;
+  }
+}
+
+
@@ -36,6 +36,10 @@ namespace Isf
       bool deflate( QByteArray& encodedData, quint8 index, const QList<qint64>& source );
       bool inflate( DataSource* source, quint64 length, quint8 index, QList<qint64>& decodedData );
 
+      // Internal use methods
+
+      void expand( const uchar* input, quint64 length, quint8 cBits, qint64* output );
+
     }
   }
 }
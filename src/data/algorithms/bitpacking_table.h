@@ -18,8 +18,8 @@
  *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
  ***************************************************************************/
 
-#ifndef ISFCOMPRESSION_BITPACKING_H
-#define ISFCOMPRESSION_BITPACKING_H
+#ifndef ISFCOMPRESSION_BITPACKING_TABLE_H
+#define ISFCOMPRESSION_BITPACKING_TABLE_H
 
 #include <QtGlobal>
 
@@ -33,7 +33,7 @@ namespace Isf {
     namespace BitPackingAlgorithm {
 
       /// Table used to compute the length of bit-packed values and their remainders.
-      quint8 bitLookUpTable_[ 48 ][ 2 ] =
+      const quint8 bitLookUpTable_[ 48 ][ 2 ] =
       {
         // { cBits, cPads }
         {  8, 0 }, // index 0
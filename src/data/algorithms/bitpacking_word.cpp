@@ -0,0 +1,144 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by the Isf-Qt developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License as        *
+ *   published by the Free Software Foundation; either version 2.1 of the  *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU Lesser General Public      *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include "isfqt-internal.h"
+#include "bitpacking_word.h"
+#include "bitpacking.h"
+#include "bitpacking_table.h"
+
+
+/// Block size of uncompressed words
+#define WORD_BITS  16
+/// Highest index of the bit lookup table usable for words
+#define WORD_MAX_INDEX  31
+
+
+using namespace Isf::Compress;
+
+
+
+/**
+ * Get the most appropriate index for the given data.
+ *
+ * Index 0 stores the words whole; the other indices refer to the bit
+ * lookup table.
+ *
+ * @param data Data to analyze
+ * @return Index value
+ */
+quint8 BitPackingWordAlgorithm::index( const QList<qint64>& data )
+{
+  quint64 allBits = 0;
+
+  foreach( qint64 value, data )
+  {
+    allBits |= value;
+  }
+
+  // Find the number of bits needed to store the biggest value
+  quint8 cBits = 1;
+  while( allBits >> cBits )
+  {
+    ++cBits;
+  }
+
+  if( cBits >= WORD_BITS )
+  {
+    return 0;
+  }
+
+  return BitPackingAlgorithm::tableIndex( cBits, data.count() );
+}
+
+
+
+/**
+ * Compress data with the Bit Packing Word algorithm.
+ *
+ * @param encodedData Byte array where to store the compressed data
+ * @param index Index to use for compression
+ * @param source List of values to compress
+ * @return bool
+ */
+bool BitPackingWordAlgorithm::deflate( QByteArray& encodedData, quint8 index, const QList<qint64>& source )
+{
+  if( index > WORD_MAX_INDEX )
+  {
+    qWarning() << "An index of" << index << "is too high!";
+    return false;
+  }
+
+  quint8 cBits = ( index == 0 ) ? WORD_BITS : BitPackingAlgorithm::bitLookUpTable_[ index ][ CBITS ];
+
+  foreach( qint64 value, source )
+  {
+    if( value < 0 || ( value >> cBits ) != 0 )
+    {
+#ifdef ISFQT_DEBUG
+      qDebug() << "Value" << value << "does not fit in" << cBits << "bits!";
+#endif
+      return false;
+    }
+  }
+
+  // The padding values are all zero bits, which the last byte already has
+  return BitPackingAlgorithm::deflate( encodedData, cBits, source );
+}
+
+
+
+/**
+ * Decompress data with the Bit Packing Word algorithm.
+ *
+ * @param source Data source where to read the compressed bytes
+ * @param length Number of bytes to read
+ * @param index Index to use for compression
+ * @param decodedData List where to place decompressed values
+ * @return bool
+ */
+bool BitPackingWordAlgorithm::inflate( DataSource* source, quint64 length, quint8 index, QList<qint64>& decodedData )
+{
+  if( index > WORD_MAX_INDEX )
+  {
+    qWarning() << "An index of" << index << "is too high!";
+    return false;
+  }
+
+  quint8 cBits = WORD_BITS;
+  quint8 cPads = 0;
+
+  if( index > 0 )
+  {
+    cBits = BitPackingAlgorithm::bitLookUpTable_[ index ][ CBITS ];
+    cPads = BitPackingAlgorithm::bitLookUpTable_[ index ][ CPADS ];
+  }
+
+  // Number of items in the compressed array
+  quint64 count = length * 8 / cBits;
+
+  if( count < cPads )
+  {
+    qWarning() << "Decompression failure!";
+    return false;
+  }
+
+  return BitPackingAlgorithm::inflate( source, count - cPads, cBits, decodedData, false /* isSigned */ );
+}
+
+
@@ -33,17 +33,11 @@ using namespace Isf::Compress;
  */
 bool Delta::transform( QList<qint64>& data )
 {
-  qint64 currentDelta  = 0;
-  qint64 previousDelta = 0;
+  State state;
 
-  for( qint64 index = 0; index < data.size(); ++index )
+  for( QList<qint64>::iterator it = data.begin(); it != data.end(); ++it )
   {
-    qint64 currentItem = data[ index ];
-
-    data[ index ] = data[ index ] + previousDelta - ( currentDelta * 2 );
-
-    previousDelta = currentDelta;
-    currentDelta = currentItem;
+    *it = state.transform( *it );
   }
 
   return true;
@@ -59,17 +53,11 @@ bool Delta::transform( QList<qint64>& data )
  */
 bool Delta::inverseTransform( QList<qint64>& data )
 {
-  qint64 currentDelta  = 0;
-  qint64 previousDelta = 0;
+  State state;
 
-  for( qint64 index = 0; index < data.size(); ++index )
+  for( QList<qint64>::iterator it = data.begin(); it != data.end(); ++it )
   {
-    qint64 delta = ( currentDelta * 2 ) - previousDelta + data[ index ];
-
-    previousDelta = currentDelta;
-    currentDelta = delta;
-
-    data[ index ] = delta;
+    *it = state.inverseTransform( *it );
   }
 
   return true;
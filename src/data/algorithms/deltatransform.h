@@ -34,6 +34,49 @@ namespace Isf
       bool transform( QList<qint64>& data );
       bool inverseTransform( QList<qint64>& data );
 
+
+
+      /**
+       * Delta-delta transformation of a sequence of values, one at a time.
+       *
+       * The codecs use it to transform values as they read or write them,
+       * instead of making a separate pass over the whole list.
+       */
+      struct State
+      {
+        /// Constructor
+        State()
+        : currentDelta( 0 )
+        , previousDelta( 0 )
+        {
+        }
+        /// Transform the next value to be deflated
+        inline qint64 transform( qint64 value )
+        {
+          qint64 result = value + previousDelta - ( currentDelta * 2 );
+
+          previousDelta = currentDelta;
+          currentDelta  = value;
+
+          return result;
+        }
+        /// Transform back the next just-inflated value
+        inline qint64 inverseTransform( qint64 value )
+        {
+          qint64 result = ( currentDelta * 2 ) - previousDelta + value;
+
+          previousDelta = currentDelta;
+          currentDelta  = result;
+
+          return result;
+        }
+
+        /// Last value of the sequence
+        qint64 currentDelta;
+        /// Value before the last one
+        qint64 previousDelta;
+      };
+
     }
   }
 }
@@ -19,14 +19,18 @@
  ***************************************************************************/
 
 #include "huffman.h"
+#include "deltatransform.h"
+#include "valuewriter.h"
 
 #include "isfqt-internal.h"
 
-#include <math.h>
+#include <algorithm>
 
 
-#define HUFFMAN_BASES_NUM   8
-#define HUFFMAN_BASE_SIZE  11
+#define HUFFMAN_BASES_NUM     8
+#define HUFFMAN_BASE_SIZE    11
+#define HUFFMAN_LOOKUP_BITS  11
+#define HUFFMAN_MAX_RANGES   ( HUFFMAN_BASES_NUM * HUFFMAN_BASE_SIZE )
 
 
 using namespace Isf::Compress;
@@ -61,19 +65,225 @@ const int huffmanBases_[HUFFMAN_BASES_NUM][HUFFMAN_BASE_SIZE] =
 
 
 
+/**
+ * Entry of a Huffman decoding table.
+ *
+ * The tables are indexed by the next HUFFMAN_LOOKUP_BITS bits of the stream,
+ * which are always enough to hold the prefix of a code. When the whole code
+ * fits in there as well, the entry holds the decoded value; otherwise, it
+ * holds the base value and the number of payload bits to read after the prefix.
+ */
+struct HuffmanCode
+{
+  /// Decoded value, or base value to add the payload to
+  qint32 value;
+  /// Bits to consume: the whole code, or only its prefix. Zero if the prefix is too long
+  quint8 length;
+  /// Payload bits to read after the prefix, zero if the value is complete
+  quint8 payloadBits;
+};
+
+
+
+/**
+ * Decoding tables for all the Huffman indices.
+ */
+struct HuffmanTables
+{
+  HuffmanTables();
+
+  HuffmanCode codes[ HUFFMAN_BASES_NUM ][ 1 << HUFFMAN_LOOKUP_BITS ];
+};
+
+
+
+/**
+ * Build the decoding tables out of the bit amounts and bases.
+ */
+HuffmanTables::HuffmanTables()
+{
+  for( quint8 index = 0; index < HUFFMAN_BASES_NUM; ++index )
+  {
+    quint8 numAmounts = 0;
+    while( numAmounts < HUFFMAN_BASE_SIZE && bitAmounts_[ index ][ numAmounts ] != -1 )
+    {
+      ++numAmounts;
+    }
+
+    for( quint32 bits = 0; bits < ( 1 << HUFFMAN_LOOKUP_BITS ); ++bits )
+    {
+      HuffmanCode& code = codes[ index ][ bits ];
+
+      // The prefix is made of as many 1s as the bit amount index, then a 0
+      quint8 count = 0;
+      while( count < HUFFMAN_LOOKUP_BITS && ( bits & ( 1 << ( HUFFMAN_LOOKUP_BITS - 1 - count ) ) ) )
+      {
+        ++count;
+      }
+
+      code.value       = 0;
+      code.payloadBits = 0;
+
+      if( count == HUFFMAN_LOOKUP_BITS )
+      {
+        code.length = 0;
+        continue;
+      }
+
+      code.length = count + 1;
+
+      // Zero is stored without payload. Values past the last bit amount
+      // (64-bit values) are not supported, and are decoded as zero as well
+      if( count == 0 || count >= numAmounts )
+      {
+        continue;
+      }
+
+      quint8 payloadBits = bitAmounts_[ index ][ count ];
+      code.value = huffmanBases_[ index ][ count ];
+
+      if( code.length + payloadBits > HUFFMAN_LOOKUP_BITS )
+      {
+        code.payloadBits = payloadBits;
+        continue;
+      }
+
+      // The whole code is in the looked up bits: decode it right away
+      quint32 offset = ( bits >> ( HUFFMAN_LOOKUP_BITS - code.length - payloadBits ) ) & ( ( 1 << payloadBits ) - 1 );
+      code.value  += ( offset >> 1 );
+      code.value  *= ( ( offset & 0x1 ) ? -1 : +1 );
+      code.length += payloadBits;
+    }
+  }
+}
+
+
+
+/**
+ * Code lengths of all the Huffman indices, by value range.
+ *
+ * The boundaries of the ranges are all the bases of all indices, plus the
+ * first value each index cannot encode anymore: within a range, every index
+ * encodes all values with the same number of bits.
+ */
+struct HuffmanCosts
+{
+  HuffmanCosts();
+
+  /// Sorted lower boundaries of the ranges, the first range (zero) excluded
+  quint64 bounds[ HUFFMAN_MAX_RANGES ];
+  /// Number of boundaries
+  quint8  numBounds;
+  /// Code length of each range for each index, zero if it cannot be encoded
+  quint8  lengths[ HUFFMAN_MAX_RANGES + 1 ][ HUFFMAN_BASES_NUM ];
+};
+
+
+
+/**
+ * Build the code length tables out of the bit amounts and bases.
+ */
+HuffmanCosts::HuffmanCosts()
+: numBounds( 0 )
+{
+  for( quint8 index = 0; index < HUFFMAN_BASES_NUM; ++index )
+  {
+    quint8 count = 1;
+    while( count < HUFFMAN_BASE_SIZE && huffmanBases_[ index ][ count ] != -1 )
+    {
+      bounds[ numBounds++ ] = huffmanBases_[ index ][ count++ ];
+    }
+
+    // The first value past the last range
+    --count;
+    bounds[ numBounds++ ] = huffmanBases_[ index ][ count ]
+                          + ( Q_UINT64_C( 1 ) << ( bitAmounts_[ index ][ count ] - 1 ) );
+  }
+
+  std::sort( bounds, bounds + numBounds );
+  numBounds = std::unique( bounds, bounds + numBounds ) - bounds;
+
+  quint64 code;
+  quint8  length;
+
+  for( quint8 range = 0; range <= numBounds; ++range )
+  {
+    qint64 value = ( range == 0 ) ? 0 : bounds[ range - 1 ];
+
+    for( quint8 index = 0; index < HUFFMAN_BASES_NUM; ++index )
+    {
+      lengths[ range ][ index ] = HuffmanAlgorithm::encodeValue( index, value, code, length ) ? length : 0;
+    }
+  }
+}
+
+
+
 /**
  * Get the most appropriate index for the given data.
  *
+ * The values are counted by range, which is enough to know the exact
+ * size of the data when compressed with each index, without compressing it.
+ *
  * @param data Data to analyze
+ * @param size If set, it will contain the size in bits of the compressed data,
+ *             or the maximum quint64 value if it cannot be compressed at all
+ * @param deltaTransform Whether to analyze the delta-delta transformed data
  * @return index value
  */
-quint8 HuffmanAlgorithm::index( const QList<qint64>& data )
+quint8 HuffmanAlgorithm::index( const QList<qint64>& data, quint64* size, bool deltaTransform )
 {
-  quint8 index = 0;
+  static const HuffmanCosts costs;
+
+  quint32 histogram[ HUFFMAN_MAX_RANGES + 1 ] = { 0 };
+  Delta::State delta;
+
+  foreach( qint64 value, data )
+  {
+    if( deltaTransform )
+    {
+      value = delta.transform( value );
+    }
+
+    quint64 offset = ( value < 0 ) ? -(quint64)value : (quint64)value;
+    ++histogram[ std::upper_bound( costs.bounds, costs.bounds + costs.numBounds, offset ) - costs.bounds ];
+  }
+
+  // Default to the index which used to be always chosen
+  quint8  index    = 2;
+  quint64 bestSize = Q_UINT64_C( -1 );
+
+  for( quint8 candidate = 0; candidate < HUFFMAN_BASES_NUM; ++candidate )
+  {
+    quint64 candidateSize = 0;
+
+    for( quint8 range = 0; range <= costs.numBounds; ++range )
+    {
+      if( histogram[ range ] == 0 )
+      {
+        continue;
+      }
+
+      if( costs.lengths[ range ][ candidate ] == 0 )
+      {
+        candidateSize = Q_UINT64_C( -1 );
+        break;
+      }
+
+      candidateSize += (quint64)histogram[ range ] * costs.lengths[ range ][ candidate ];
+    }
 
-  // TODO: Find out what the Huffman index algorithm is
-  Q_UNUSED( data )
-  index = 2;
+    if( candidateSize < bestSize )
+    {
+      index    = candidate;
+      bestSize = candidateSize;
+    }
+  }
+
+  if( size != nullptr )
+  {
+    *size = bestSize;
+  }
 
   return index;
 }
@@ -83,25 +293,66 @@ quint8 HuffmanAlgorithm::index( const QList<qint64>& data )
 /**
  * Compress data with the Huffman algorithm.
  *
+ * The size of the compressed data is computed beforehand, so that the
+ * output array only needs to be allocated once.
+ *
  * @param encodedData Byte array where to store the compressed data
  * @param index Index to use for compression
  * @param source List of values to compress
+ * @param deltaTransform Whether to delta-delta transform the values while compressing them
  * @return bool
  */
-bool HuffmanAlgorithm::deflate( QByteArray& encodedData, quint8 index, const QList<qint64>& source )
+bool HuffmanAlgorithm::deflate( QByteArray& encodedData, quint8 index, const QList<qint64>& source, bool deltaTransform )
 {
-  DataSource output( encodedData );
-  output.skipToNextByte();
+  if( index >= HUFFMAN_BASES_NUM )
+  {
+#ifdef ISFQT_DEBUG
+    qDebug() << "Invalid Huffman index:" << index;
+#endif
+    return false;
+  }
+
+  quint64 code;
+  quint8  length;
+  quint64 totalLength = 0;
+  Delta::State delta;
 
-  foreach( quint64 value, source )
+  foreach( qint64 value, source )
   {
-    if( ! deflateValue( &output, index, value ) )
+    if( deltaTransform )
+    {
+      value = delta.transform( value );
+    }
+
+    if( ! encodeValue( index, value, code, length ) )
     {
 #ifdef ISFQT_DEBUG
       qDebug() << "Deflating failure for value:" << value;
 #endif
       return false;
     }
+
+    totalLength += length;
+  }
+
+  encodedData.reserve( encodedData.size() + ( totalLength + 7 ) / 8 );
+
+  // Hand the array over to the data source, so it can be appended to
+  // without being copied
+  DataSource output( encodedData );
+  encodedData.clear();
+
+  delta = Delta::State();
+
+  foreach( qint64 value, source )
+  {
+    if( deltaTransform )
+    {
+      value = delta.transform( value );
+    }
+
+    encodeValue( index, value, code, length );
+    output.appendBits( code, length );
   }
 
   // Flush any leftover bit to the byte array
@@ -123,69 +374,147 @@ bool HuffmanAlgorithm::deflate( QByteArray& encodedData, quint8 index, const QLi
  */
 bool HuffmanAlgorithm::deflateValue( DataSource* output, quint8 index, qint64 value )
 {
-  qint64 temp = value;
-  quint8 requiredBits = 0;
-  QBitArray valueBits;
+  quint64 code;
+  quint8  length;
 
-  // Fill in a bitAmounts local vector
-  QVector<int> bitAmounts;
-  for( int i = 0; i < HUFFMAN_BASE_SIZE; ++i )
+  if( index >= HUFFMAN_BASES_NUM || ! encodeValue( index, value, code, length ) )
   {
-    if( bitAmounts_[ index ][ i ] == -1 )
-    {
-      break;
-    }
-
-    bitAmounts.append( bitAmounts_[ index ][ i ] );
+    return false;
   }
 
-  // Find the number of bits needed to store this value
-  while( temp )
+  output->appendBits( code, length );
+  return true;
+}
+
+
+
+/**
+ * Find the Huffman code of a single value.
+ *
+ * The code is made of a prefix, as many 1s as the position of the value's
+ * range within the bases table followed by a 0, then of the offset of the
+ * value from its base and finally of the sign bit.
+ *
+ * @param index Index to use for compression
+ * @param value Value to compress
+ * @param code Will contain the code bits, in the least significant bits
+ * @param length Will contain the number of bits of the code
+ * @return bool, false if the value is too large to be encoded
+ */
+bool HuffmanAlgorithm::encodeValue( quint8 index, qint64 value, quint64& code, quint8& length )
+{
+  const int* bitAmounts = bitAmounts_[ index ];
+  const int* bases      = huffmanBases_[ index ];
+
+  quint64 offset = ( value < 0 ) ? -(quint64)value : (quint64)value;
+
+  if( offset == 0 )
   {
-    temp /= 2;
-    ++requiredBits;
+    code   = 0;
+    length = 1;
+    return true;
   }
 
-  while( ! bitAmounts.count( requiredBits ) )
+  // Find the range the value falls into
+  quint8 count = 1;
+  while( count + 1 < HUFFMAN_BASE_SIZE
+      && bases[ count + 1 ] != -1
+      && offset >= (quint64)bases[ count + 1 ] )
   {
-    ++requiredBits;
+    ++count;
   }
 
-  qint64 offset = ( value < 0 ) ? -value : +value;
+  quint8 payloadBits = bitAmounts[ count ];
+  offset -= bases[ count ];
 
-  quint8 prefixLength;
-  for( prefixLength = 1;
-        ( prefixLength < HUFFMAN_BASE_SIZE ) && ( offset >= huffmanBases_[ index ][ prefixLength ] ); prefixLength++ )
+  // 64-bit values are not supported
+  if( ( offset >> ( payloadBits - 1 ) ) != 0 )
   {
-    // Empty loop on purpose
+    return false;
   }
 
+  quint64 prefix = ( ( Q_UINT64_C( 1 ) << count ) - 1 ) << 1;
+
+  code   = ( prefix << payloadBits ) | ( offset << 1 ) | ( ( value < 0 ) ? 1 : 0 );
+  length = count + 1 + payloadBits;
+  return true;
+}
 
-  // Write prefixLength 1s to the stream, then a 0
-  QBitArray bits( prefixLength );
-  bits.fill( true );
-  bits.clearBit( bits.size() - 1 );
 
-  // Write the number using the minimum possible number of bits
-  qint32 size = bitAmounts_[ index ][ prefixLength - 1 ];
-  qint64 mask = ( 1 << ( size - 1 ) ) - 1;
 
-  valueBits.resize( size );
-  offset = ( offset - huffmanBases_[ index ][ prefixLength - 1 ] ) & mask;
-  offset <<= 1;
-  offset |= ( value < 0 ) ? 1 : 0;
+/**
+ * Decode Huffman codes with the given decoding table.
+ *
+ * @param source Data source where to read the compressed bytes
+ * @param length Number of items to read
+ * @param codes Decoding table of the index to use
+ * @param output QList or ValueWriter where to place decompressed values
+ * @param deltaTransform Whether to delta-delta inverse transform the values while decompressing them
+ */
+template<class Output>
+static void inflateValues( DataSource* source, quint64 length, const HuffmanCode* codes, Output& output, bool deltaTransform )
+{
+  Delta::State delta;
+  qint64 value;
 
-  // Copy the resulting offset
-  for( qint64 i = 0; i < size; ++i )
+  for( quint64 index = 0; index < length; ++index )
   {
-    valueBits.setBit( i, offset & ( 1 << ( size - i - 1 ) ) );
+    const HuffmanCode& code = codes[ source->peekBits( HUFFMAN_LOOKUP_BITS ) ];
+
+    if( code.length == 0 )
+    {
+      // A prefix this long is not valid for any index
+#ifdef ISFQT_DEBUG
+      qDebug() << "Decompression error!";
+#endif
+      source->skipBits( HUFFMAN_LOOKUP_BITS );
+      while( source->getBit() )
+      {
+        // Empty loop on purpose
+      }
+
+      value = 0;
+    }
+    else if( code.payloadBits == 0 )
+    {
+      source->skipBits( code.length );
+      value = code.value;
+    }
+    else
+    {
+      source->skipBits( code.length );
+
+      quint64 offset = source->getBits( code.payloadBits );
+      value = code.value + ( offset >> 1 );
+      value = ( offset & 0x1 ) ? -value : value;
+    }
+
+    output.append( deltaTransform ? delta.inverseTransform( value ) : value );
   }
+}
 
-  // Add the bits to the data source
-  output->append( bits );
-  output->append( valueBits );
 
-  return true;
+
+/**
+ * Get the decoding table of a Huffman index.
+ *
+ * The tables for all indices are built the first time they are needed.
+ *
+ * @param index Index to use for compression
+ * @return Decoding table, or null if the index is not valid
+ */
+static const HuffmanCode* decodingTable( quint8 index )
+{
+  if( index >= HUFFMAN_BASES_NUM )
+  {
+#ifdef ISFQT_DEBUG
+    qDebug() << "Invalid Huffman index:" << index;
+#endif
+    return nullptr;
+  }
+
+  static const HuffmanTables tables;
+  return tables.codes[ index ];
 }
 
 
@@ -193,91 +522,78 @@ bool HuffmanAlgorithm::deflateValue( DataSource* output, quint8 index, qint64 va
 /**
  * Decompress data with the Huffman algorithm.
  *
+ * Codes are decoded by looking up the next bits of the stream in a table,
+ * which is built once for all indices.
+ *
  * @param source Data source where to read the compressed bytes
  * @param length Number of items to read
  * @param index Index to use for compression
  * @param decodedData List where to place decompressed values
+ * @param deltaTransform Whether to delta-delta inverse transform the values while decompressing them
  * @return bool
  */
-bool HuffmanAlgorithm::inflate( DataSource* source, quint64 length, quint8 index, QList<qint64>& decodedData )
+bool HuffmanAlgorithm::inflate( DataSource* source, quint64 length, quint8 index, QList<qint64>& decodedData, bool deltaTransform )
 {
-  QVector<int> huffmanBases;
-  QVector<int> bitAmounts( HUFFMAN_BASE_SIZE );
-
-  // Initialize the bit amounts vector
-  memcpy( bitAmounts.data(), bitAmounts_[ index ], sizeof(int)*HUFFMAN_BASE_SIZE );
-
-  int base = 1;
-  huffmanBases.append( 0 );
-
-  // Fill up the huffman bases vector
-  for( quint8 i = 0; i < bitAmounts.size(); ++i )
+  const HuffmanCode* codes = decodingTable( index );
+  if( codes == nullptr )
   {
-    int value = bitAmounts[ i ];
+    return false;
+  }
 
-    // The bit amounts sequence ends in -1
-    if( value == -1 )
-    {
-      bitAmounts.resize( i );
-      break;
-    }
+  // Every code takes at least one bit
+  decodedData.reserve( decodedData.size() + qMin( length, (quint64)( source->size() - source->pos() ) * 8 ) );
 
-    if( value == 0 )
-    {
-      continue;
-    }
-
-    huffmanBases.append( base );
-    base += pow( 2, value - 1 );
-  }
+  inflateValues( source, length, codes, decodedData, deltaTransform );
+  return true;
+}
 
 
-  quint32 count = 0;
-  qint64 value = 0;
-  bool bit;
 
-  while( (uint)decodedData.length() < length )
+/**
+ * Decompress data with the Huffman algorithm, into an array of 32 bits values.
+ *
+ * @param source Data source where to read the compressed bytes
+ * @param length Number of items to read
+ * @param index Index to use for compression
+ * @param decodedData Array where to place decompressed values, with room for [length] values
+ * @param deltaTransform Whether to delta-delta inverse transform the values while decompressing them
+ * @return bool
+ */
+bool HuffmanAlgorithm::inflate( DataSource* source, quint64 length, quint8 index, qint32* decodedData, bool deltaTransform )
+{
+  const HuffmanCode* codes = decodingTable( index );
+  if( codes == nullptr )
   {
-    bit = source->getBit();
+    return false;
+  }
+
+  ValueWriter<qint32> output( decodedData );
+  inflateValues( source, length, codes, output, deltaTransform );
+  return true;
+}
 
-    if( bit )
-    {
-      count++;
-      continue;
-    }
 
-    if( count == 0 )
-    {
-      value = 0;
-    }
-    else if( count < (uint)bitAmounts.size() )
-    {
-      quint64 offset = source->getBits( bitAmounts[ count ] );
-      bool sign = offset & 0x1;
-      offset /= 2;
-      value = huffmanBases[ count ] + offset;
-      value *= ( sign ? -1 : +1 );
-    }
-    else if( count == (uint)bitAmounts.size() )
-    {
-      // TODO: Implement 64-bit data decompression :)
-#ifdef ISFQT_DEBUG
-      qDebug() << "Unsupported 64-bit value found!";
-#endif
-      value = 0;
-    }
-    else
-    {
-#ifdef ISFQT_DEBUG
-      qDebug() << "Decompression error!";
-#endif
-      value = 0;
-    }
 
-    decodedData.append( value );
-    count = 0;
+/**
+ * Decompress data with the Huffman algorithm, into an array of 64 bits values.
+ *
+ * @param source Data source where to read the compressed bytes
+ * @param length Number of items to read
+ * @param index Index to use for compression
+ * @param decodedData Array where to place decompressed values, with room for [length] values
+ * @param deltaTransform Whether to delta-delta inverse transform the values while decompressing them
+ * @return bool
+ */
+bool HuffmanAlgorithm::inflate( DataSource* source, quint64 length, quint8 index, qint64* decodedData, bool deltaTransform )
+{
+  const HuffmanCode* codes = decodingTable( index );
+  if( codes == nullptr )
+  {
+    return false;
   }
 
+  ValueWriter<qint64> output( decodedData );
+  inflateValues( source, length, codes, output, deltaTransform );
   return true;
 }
 
@@ -32,13 +32,16 @@ namespace Isf
     namespace HuffmanAlgorithm
     {
 
-      bool   deflate( QByteArray& encodedData, quint8 index, const QList<qint64>& source );
-      bool   inflate( DataSource* source, quint64 length, quint8 index, QList<qint64>& decodedData );
-      quint8 index( const QList<qint64>& data );
+      bool   deflate( QByteArray& encodedData, quint8 index, const QList<qint64>& source, bool deltaTransform = false );
+      bool   inflate( DataSource* source, quint64 length, quint8 index, QList<qint64>& decodedData, bool deltaTransform = false );
+      bool   inflate( DataSource* source, quint64 length, quint8 index, qint32* decodedData, bool deltaTransform = false );
+      bool   inflate( DataSource* source, quint64 length, quint8 index, qint64* decodedData, bool deltaTransform = false );
+      quint8 index( const QList<qint64>& data, quint64* size = 0, bool deltaTransform = false );
 
       // Internal use methods
 
       bool   deflateValue( DataSource* output, quint8 index, qint64 value );
+      bool   encodeValue( quint8 index, qint64 value, quint64& code, quint8& length );
 
     }
   }
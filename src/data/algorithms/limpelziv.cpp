@@ -0,0 +1,308 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by the Isf-Qt developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License as        *
+ *   published by the Free Software Foundation; either version 2.1 of the  *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU Lesser General Public      *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include "isfqt-internal.h"
+#include "limpelziv.h"
+
+#include <QVector>
+
+
+/// Size of the sliding window shared by the encoder and decoder
+#define LZ_WINDOW_SIZE  4096
+/// Mask to wrap positions around the window
+#define LZ_WINDOW_MASK  ( LZ_WINDOW_SIZE - 1 )
+/// Shortest match worth a reference
+#define LZ_MIN_MATCH  3
+/// Longest match a reference can hold
+#define LZ_MAX_MATCH  18
+/// Window position where the first decoded byte is stored
+#define LZ_WINDOW_START  ( LZ_WINDOW_SIZE - LZ_MAX_MATCH )
+/// Farthest back the encoder may look for a match
+#define LZ_MAX_DISTANCE  ( LZ_WINDOW_SIZE - LZ_MAX_MATCH )
+/// Number of buckets in the encoder's match hash table
+#define LZ_HASH_SIZE  4096
+/// Number of earlier matches the encoder compares before giving up
+#define LZ_MAX_CHAIN  64
+
+
+using namespace Isf::Compress;
+
+
+
+/**
+ * Compress data with the Limpel-Ziv algorithm.
+ *
+ * The data is laid out in groups of up to eight items, each group preceded
+ * by a flags byte: a set bit (starting from the lowest one) marks a literal
+ * byte, a clear bit marks a two bytes reference to an earlier run of bytes
+ * within the window, made of a 12 bits position and a 4 bits length.
+ *
+ * Matches are found through hash chains of the three bytes which start them.
+ *
+ * @param encodedData Byte array where to store the compressed data
+ * @param source List of values to compress
+ * @return bool
+ */
+bool LimpelZivAlgorithm::deflate( QByteArray& encodedData, const QList<qint64>& source )
+{
+  const int count = source.count();
+
+  QByteArray bytes( count, '\0' );
+  uchar* input = reinterpret_cast<uchar*>( bytes.data() );
+
+  for( int i = 0; i < count; ++i )
+  {
+    qint64 value = source.at( i );
+
+    if( value < 0 || value > 0xFF )
+    {
+#ifdef ISFQT_DEBUG
+      qDebug() << "Value" << value << "does not fit in a byte!";
+#endif
+      return false;
+    }
+
+    input[ i ] = value;
+  }
+
+  // Worst case, every item is a literal byte, plus one flags byte every eight items
+  const int offset = encodedData.size();
+  encodedData.resize( offset + count + ( count + 7 ) / 8 );
+
+  uchar* output = reinterpret_cast<uchar*>( encodedData.data() ) + offset;
+  uchar* start  = output;
+  uchar* flags  = nullptr;
+  quint8 flagBit = 8;
+
+  QVector<int> head( LZ_HASH_SIZE, -1 );
+  QVector<int> previous( LZ_WINDOW_SIZE, -1 );
+
+  int position = 0;
+  while( position < count )
+  {
+    int matchLength = 0;
+    int matchPosition = 0;
+
+    if( position + LZ_MIN_MATCH <= count )
+    {
+      const int maxLength = qMin( LZ_MAX_MATCH, count - position );
+      const uchar* current = input + position;
+      int candidate = head[ ( ( current[0] << 4 ) ^ ( current[1] << 2 ) ^ current[2] ) & ( LZ_HASH_SIZE - 1 ) ];
+      int chain = LZ_MAX_CHAIN;
+
+      while( candidate >= 0 && position - candidate <= LZ_MAX_DISTANCE && chain-- > 0 )
+      {
+        const uchar* match = input + candidate;
+        int length = 0;
+        while( length < maxLength && match[ length ] == current[ length ] )
+        {
+          ++length;
+        }
+
+        if( length > matchLength )
+        {
+          matchLength = length;
+          matchPosition = candidate;
+
+          if( length == maxLength )
+          {
+            break;
+          }
+        }
+
+        candidate = previous[ candidate & LZ_WINDOW_MASK ];
+      }
+    }
+
+    // Start a new group of items
+    if( flagBit == 8 )
+    {
+      flags = output++;
+      *flags = 0;
+      flagBit = 0;
+    }
+
+    int advance = 1;
+
+    if( matchLength >= LZ_MIN_MATCH )
+    {
+      quint16 windowPosition = ( LZ_WINDOW_START + matchPosition ) & LZ_WINDOW_MASK;
+
+      *output++ = windowPosition & 0xFF;
+      *output++ = ( ( windowPosition >> 4 ) & 0xF0 ) | ( matchLength - LZ_MIN_MATCH );
+
+      advance = matchLength;
+    }
+    else
+    {
+      *flags |= ( 1 << flagBit );
+      *output++ = input[ position ];
+    }
+
+    ++flagBit;
+
+    // Add the consumed bytes to the hash chains
+    for( int end = position + advance; position < end; ++position )
+    {
+      if( position + LZ_MIN_MATCH > count )
+      {
+        continue;
+      }
+
+      const uchar* current = input + position;
+      int hash = ( ( current[0] << 4 ) ^ ( current[1] << 2 ) ^ current[2] ) & ( LZ_HASH_SIZE - 1 );
+
+      previous[ position & LZ_WINDOW_MASK ] = head[ hash ];
+      head[ hash ] = position;
+    }
+  }
+
+  encodedData.resize( offset + ( output - start ) );
+
+  return true;
+}
+
+
+
+/**
+ * Decompress data with the Limpel-Ziv algorithm.
+ *
+ * The output list is sized once, with a quick scan of the compressed data;
+ * then the bytes are decoded through a fixed window, in a single pass.
+ *
+ * @param source Data source where to read the compressed bytes
+ * @param length Number of bytes to read
+ * @param decodedData List where to place decompressed values
+ * @return bool
+ */
+bool LimpelZivAlgorithm::inflate( DataSource* source, quint64 length, QList<qint64>& decodedData )
+{
+  bool ok;
+  const QByteArray bytes( source->getBytes( length, &ok ) );
+
+  if( ! ok )
+  {
+    qWarning() << "Decompression failure!";
+    return false;
+  }
+
+  const uchar* input = reinterpret_cast<const uchar*>( bytes.constData() );
+  const uchar* end   = input + bytes.size();
+
+  decodedData.reserve( decodedData.size() + inflatedSize( input, bytes.size() ) );
+
+  uchar   window[ LZ_WINDOW_SIZE ] = { 0 };
+  quint16 windowPosition = LZ_WINDOW_START;
+  quint16 flags = 0;
+
+  while( input < end )
+  {
+    // Each flags byte is followed by up to eight items
+    flags >>= 1;
+    if( ( flags & 0x100 ) == 0 )
+    {
+      flags = *input++ | 0xFF00;
+
+      if( input == end )
+      {
+        break;
+      }
+    }
+
+    if( flags & 1 )
+    {
+      window[ windowPosition ] = *input;
+      windowPosition = ( windowPosition + 1 ) & LZ_WINDOW_MASK;
+
+      decodedData.append( *input++ );
+      continue;
+    }
+
+    if( end - input < 2 )
+    {
+      qWarning() << "Decompression failure!";
+      return false;
+    }
+
+    quint16 position = input[0] | ( ( input[1] & 0xF0 ) << 4 );
+    quint8  matchLength = ( input[1] & 0x0F ) + LZ_MIN_MATCH;
+    input += 2;
+
+    for( quint8 i = 0; i < matchLength; ++i )
+    {
+      uchar byte = window[ ( position + i ) & LZ_WINDOW_MASK ];
+
+      window[ windowPosition ] = byte;
+      windowPosition = ( windowPosition + 1 ) & LZ_WINDOW_MASK;
+
+      decodedData.append( byte );
+    }
+  }
+
+  return true;
+}
+
+
+
+/**
+ * Count the bytes which a block of Limpel-Ziv compressed data expands to.
+ *
+ * @param input Compressed bytes
+ * @param length Number of compressed bytes
+ * @return Number of decompressed bytes
+ */
+quint64 LimpelZivAlgorithm::inflatedSize( const uchar* input, quint64 length )
+{
+  const uchar* end = input + length;
+  quint64 size  = 0;
+  quint16 flags = 0;
+
+  while( input < end )
+  {
+    flags >>= 1;
+    if( ( flags & 0x100 ) == 0 )
+    {
+      flags = *input++ | 0xFF00;
+
+      if( input == end )
+      {
+        break;
+      }
+    }
+
+    if( flags & 1 )
+    {
+      ++input;
+      ++size;
+      continue;
+    }
+
+    if( end - input < 2 )
+    {
+      break;
+    }
+
+    size += ( input[1] & 0x0F ) + LZ_MIN_MATCH;
+    input += 2;
+  }
+
+  return size;
+}
+
+
@@ -0,0 +1,46 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by the Isf-Qt developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License as        *
+ *   published by the Free Software Foundation; either version 2.1 of the  *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU Lesser General Public      *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef ISFCOMPRESSION_LIMPELZIV_H
+#define ISFCOMPRESSION_LIMPELZIV_H
+
+#include "../datasource.h"
+
+
+
+namespace Isf
+{
+  namespace Compress
+  {
+    namespace LimpelZivAlgorithm
+    {
+
+      bool deflate( QByteArray& encodedData, const QList<qint64>& source );
+      bool inflate( DataSource* source, quint64 length, QList<qint64>& decodedData );
+
+      // Internal use methods
+      quint64 inflatedSize( const uchar* input, quint64 length );
+
+    }
+  }
+}
+
+
+
+#endif
@@ -0,0 +1,65 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by the Isf-Qt developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License as        *
+ *   published by the Free Software Foundation; either version 2.1 of the  *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU Lesser General Public      *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef ISFCOMPRESSION_VALUEWRITER_H
+#define ISFCOMPRESSION_VALUEWRITER_H
+
+#include <QtGlobal>
+
+
+
+namespace Isf
+{
+  namespace Compress
+  {
+
+
+
+    /**
+     * Writes decompressed values into a preallocated array.
+     *
+     * It has the same append() method as QList, so that the decoders
+     * can fill either of them with the same code.
+     */
+    template<typename T>
+    struct ValueWriter
+    {
+      /// Constructor
+      ValueWriter( T* output )
+      : output_( output )
+      {
+      }
+      /// Write the next value
+      inline void append( qint64 value )
+      {
+        *output_++ = value;
+      }
+
+      /// Where the next value will be written
+      T* output_;
+    };
+
+
+
+  }
+}
+
+
+
+#endif
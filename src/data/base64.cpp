@@ -0,0 +1,308 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by the Isf-Qt developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License as        *
+ *   published by the Free Software Foundation; either version 2.1 of the  *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU Lesser General Public      *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include "base64.h"
+
+
+using namespace Isf::Compress;
+
+
+
+/// Characters used to encode each group of 6 bits
+static const char base64EncodeTable[] =
+  "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/// Value of each character, or 0x80 for characters outside of the alphabet
+static const quint8 base64DecodeTable[ 256 ] =
+{
+  0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+  0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+  0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x3E, 0x80, 0x80, 0x80, 0x3F,
+  0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+  0x80, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E,
+  0x0F, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x80, 0x80, 0x80, 0x80, 0x80,
+  0x80, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+  0x29, 0x2A, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F, 0x30, 0x31, 0x32, 0x33, 0x80, 0x80, 0x80, 0x80, 0x80,
+  0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+  0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+  0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+  0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+  0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+  0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+  0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+  0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80
+};
+
+
+
+/**
+ * Constructor.
+ */
+Base64Decoder::Base64Decoder()
+: bits_( 0 )
+, bitCount_( 0 )
+{
+}
+
+
+
+/**
+ * Decode a piece of Base64 text.
+ *
+ * The characters which do not complete a byte are kept, and decoded along
+ * with the next piece.
+ *
+ * @param input Base64 characters to decode
+ * @param length Number of characters
+ * @param output Where to write the bytes: must have room for
+ *               maximumDecodedSize( length ) bytes
+ * @return Number of bytes written
+ */
+int Base64Decoder::decode( const char* input, int length, char* output )
+{
+  const uchar* in  = reinterpret_cast<const uchar*>( input );
+  const uchar* end = in + length;
+  char*        out = output;
+
+  while( in < end )
+  {
+    // Fast path: whole groups of valid characters, when no bits are left over
+    if( bitCount_ == 0 )
+    {
+      while( end - in >= 4 )
+      {
+        const quint32 a = base64DecodeTable[ in[ 0 ] ];
+        const quint32 b = base64DecodeTable[ in[ 1 ] ];
+        const quint32 c = base64DecodeTable[ in[ 2 ] ];
+        const quint32 d = base64DecodeTable[ in[ 3 ] ];
+
+        if( ( a | b | c | d ) & 0x80 )
+        {
+          break;
+        }
+
+        const quint32 group = ( a << 18 ) | ( b << 12 ) | ( c << 6 ) | d;
+        out[ 0 ] = (char)( group >> 16 );
+        out[ 1 ] = (char)( group >> 8 );
+        out[ 2 ] = (char)( group );
+
+        in  += 4;
+        out += 3;
+      }
+
+      if( in == end )
+      {
+        break;
+      }
+    }
+
+    // Slow path: one character at a time, skipping the invalid ones
+    const quint8 value = base64DecodeTable[ *in++ ];
+    if( value & 0x80 )
+    {
+      continue;
+    }
+
+    bits_ = ( bits_ << 6 ) | value;
+    bitCount_ += 6;
+
+    if( bitCount_ >= 8 )
+    {
+      bitCount_ -= 8;
+      *out++ = (char)( bits_ >> bitCount_ );
+      bits_ &= ( 1 << bitCount_ ) - 1;
+    }
+  }
+
+  return out - output;
+}
+
+
+
+/**
+ * Forget the bits left over from the last piece.
+ */
+void Base64Decoder::reset()
+{
+  bits_     = 0;
+  bitCount_ = 0;
+}
+
+
+
+/**
+ * Decode a whole Base64 text at once.
+ *
+ * The text is read only once. The output is allocated for the longest
+ * possible result, so it is only larger than needed by the share of the
+ * characters which are skipped, like line breaks and padding.
+ *
+ * @param input Base64 characters to decode
+ * @return Decoded bytes
+ */
+QByteArray Base64Decoder::decode( const QByteArray& input )
+{
+  QByteArray output;
+  output.resize( maximumDecodedSize( input.size() ) );
+
+  Base64Decoder decoder;
+  output.resize( decoder.decode( input.constData(), input.size(), output.data() ) );
+
+  return output;
+}
+
+
+
+/**
+ * Return how many bytes a piece of Base64 text can decode to, at most.
+ *
+ * @param length Number of characters
+ * @return Maximum number of bytes
+ */
+int Base64Decoder::maximumDecodedSize( int length )
+{
+  // The bits left over from the last piece may complete one more byte
+  return ( length / 4 ) * 3 + 3;
+}
+
+
+
+/**
+ * Constructor.
+ */
+Base64Encoder::Base64Encoder()
+: pendingCount_( 0 )
+{
+}
+
+
+
+/**
+ * Encode a piece of data.
+ *
+ * The bytes which do not make a whole group are kept, and encoded along
+ * with the next piece, or by finish().
+ *
+ * @param input Bytes to encode
+ * @param length Number of bytes
+ * @param output Where to write the characters: must have room for
+ *               maximumEncodedSize( length ) characters
+ * @return Number of characters written
+ */
+int Base64Encoder::encode( const char* input, int length, char* output )
+{
+  const uchar* in  = reinterpret_cast<const uchar*>( input );
+  const uchar* end = in + length;
+  char*        out = output;
+
+  // Complete the group left over from the last piece first
+  if( pendingCount_ > 0 )
+  {
+    while( pendingCount_ < 3 && in < end )
+    {
+      pending_[ pendingCount_++ ] = *in++;
+    }
+
+    if( pendingCount_ < 3 )
+    {
+      return 0;
+    }
+
+    const quint32 group = ( pending_[ 0 ] << 16 ) | ( pending_[ 1 ] << 8 ) | pending_[ 2 ];
+    out[ 0 ] = base64EncodeTable[ ( group >> 18 ) & 0x3F ];
+    out[ 1 ] = base64EncodeTable[ ( group >> 12 ) & 0x3F ];
+    out[ 2 ] = base64EncodeTable[ ( group >>  6 ) & 0x3F ];
+    out[ 3 ] = base64EncodeTable[   group         & 0x3F ];
+
+    out += 4;
+    pendingCount_ = 0;
+  }
+
+  while( end - in >= 3 )
+  {
+    const quint32 group = ( in[ 0 ] << 16 ) | ( in[ 1 ] << 8 ) | in[ 2 ];
+    out[ 0 ] = base64EncodeTable[ ( group >> 18 ) & 0x3F ];
+    out[ 1 ] = base64EncodeTable[ ( group >> 12 ) & 0x3F ];
+    out[ 2 ] = base64EncodeTable[ ( group >>  6 ) & 0x3F ];
+    out[ 3 ] = base64EncodeTable[   group         & 0x3F ];
+
+    in  += 3;
+    out += 4;
+  }
+
+  while( in < end )
+  {
+    pending_[ pendingCount_++ ] = *in++;
+  }
+
+  return out - output;
+}
+
+
+
+/**
+ * Encode the bytes left over, padding the last group.
+ *
+ * @param output Where to write the characters: must have room for 4
+ *               characters
+ * @return Number of characters written
+ */
+int Base64Encoder::finish( char* output )
+{
+  if( pendingCount_ == 0 )
+  {
+    return 0;
+  }
+
+  const quint32 group = ( pending_[ 0 ] << 16 )
+                      | ( pendingCount_ > 1 ? pending_[ 1 ] << 8 : 0 );
+  output[ 0 ] = base64EncodeTable[ ( group >> 18 ) & 0x3F ];
+  output[ 1 ] = base64EncodeTable[ ( group >> 12 ) & 0x3F ];
+  output[ 2 ] = pendingCount_ > 1 ? base64EncodeTable[ ( group >> 6 ) & 0x3F ] : '=';
+  output[ 3 ] = '=';
+
+  pendingCount_ = 0;
+
+  return 4;
+}
+
+
+
+/**
+ * Forget the bytes left over from the last piece.
+ */
+void Base64Encoder::reset()
+{
+  pendingCount_ = 0;
+}
+
+
+
+/**
+ * Return how many characters a piece of data can encode to, at most.
+ *
+ * This is also the size of a whole stream encoded at once, with finish().
+ *
+ * @param length Number of bytes
+ * @return Maximum number of characters
+ */
+int Base64Encoder::maximumEncodedSize( int length )
+{
+  return ( ( length + 2 ) / 3 ) * 4;
+}
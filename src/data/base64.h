@@ -0,0 +1,103 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by the Isf-Qt developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License as        *
+ *   published by the Free Software Foundation; either version 2.1 of the  *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU Lesser General Public      *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef BASE64_H
+#define BASE64_H
+
+#include <QByteArray>
+
+
+
+namespace Isf
+{
+  namespace Compress
+  {
+    /**
+     * @class Base64Decoder
+     * @brief Decodes Base64 text, a piece at a time.
+     *
+     * Whole groups of four characters are turned into three bytes at once;
+     * everything else, like line breaks, padding and groups split across
+     * pieces, goes through a slower path which keeps the bits left over.
+     *
+     * Like QByteArray::fromBase64(), characters outside of the Base64
+     * alphabet are skipped.
+     */
+    class Base64Decoder
+    {
+
+      public: // Public constructors
+                          Base64Decoder();
+
+      public: // Public methods
+        int               decode( const char* input, int length, char* output );
+        void              reset();
+
+      public: // Public static methods
+        static QByteArray decode( const QByteArray& input );
+        static int        maximumDecodedSize( int length );
+
+      private: // Private properties
+        /// Decoded bits which do not fill a whole byte yet
+        quint32           bits_;
+        /// Number of valid bits in bits_
+        quint8            bitCount_;
+
+    };
+
+
+
+    /**
+     * @class Base64Encoder
+     * @brief Encodes bytes to Base64 text, a piece at a time.
+     *
+     * Every group of three bytes is turned into four characters; the bytes
+     * which do not make a whole group are kept for the next piece, until
+     * finish() pads them.
+     */
+    class Base64Encoder
+    {
+
+      public: // Public constructors
+                          Base64Encoder();
+
+      public: // Public methods
+        int               encode( const char* input, int length, char* output );
+        int               finish( char* output );
+        void              reset();
+
+      public: // Public static methods
+        static int        maximumEncodedSize( int length );
+
+      private: // Private properties
+        /// Bytes which do not make a whole group yet
+        uchar             pending_[ 3 ];
+        /// Number of valid bytes in pending_
+        quint8            pendingCount_;
+
+    };
+
+
+
+  }
+}
+
+
+
+#endif
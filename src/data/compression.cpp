@@ -23,11 +23,14 @@
 #include "isfqt-internal.h"
 #include "algorithms/bitpacking.h"
 #include "algorithms/bitpacking_byte.h"
+#include "algorithms/bitpacking_long.h"
+#include "algorithms/bitpacking_word.h"
 #include "algorithms/huffman.h"
-#include "algorithms/deltatransform.h"
+#include "algorithms/limpelziv.h"
 
 
 using namespace Isf;
+using namespace Isf::Compress;
 
 
 
@@ -39,10 +42,11 @@ using namespace Isf;
  *
  * @param source Data Source where to read compressed bytes from
  * @param length Number of items to decompress
- * @param decodedData List where to store the decoded values
+ * @param decodedData List, or array with room for [length] values, where to store the decoded values
  * @return bool
  */
-bool Compress::inflatePacketData( DataSource* source, quint64 length, QList<qint64>& decodedData )
+template<class Output>
+static bool inflatePacket( DataSource* source, quint64 length, Output decodedData )
 {
   if( source->atEnd() )
   {
@@ -79,8 +83,8 @@ bool Compress::inflatePacketData( DataSource* source, quint64 length, QList<qint
     algorithmData = ( HuffmanMask & byte );
   }
   // According to the specs, the only other algorithm for packet data
-  // is generic bit packing.
-  else if( algorithm == BitPacking )
+  // is generic bit packing. The lower bits are all algorithm data.
+  else if( ( algorithm & DefaultCompression ) == BitPacking )
   {
     algorithm = BitPacking;
     algorithmData = ( BitPackingMask & byte );
@@ -108,12 +112,8 @@ bool Compress::inflatePacketData( DataSource* source, quint64 length, QList<qint
       qDebug() << "- Inflating" << length << "items using the Bit Packing algorithm and a block size of" << algorithmData;
 #endif
 
-      result = BitPackingAlgorithm::inflate( source, length, algorithmData, decodedData );
-
-      if( result && requiresDeltaDeltaTransform )
-      {
-        result = Delta::inverseTransform( decodedData );
-      }
+      result = BitPackingAlgorithm::inflate( source, length, algorithmData, decodedData,
+                                             true /* isSigned */, requiresDeltaDeltaTransform );
       break;
     }
 
@@ -122,13 +122,8 @@ bool Compress::inflatePacketData( DataSource* source, quint64 length, QList<qint
 #ifdef ISFQT_DEBUG_VERBOSE
       qDebug() << "- Inflating" << length << "items using the Huffman algorithm and index" << algorithmData;
 #endif
-      result = HuffmanAlgorithm::inflate( source, length, algorithmData, decodedData );
-
       // Always delta-inverse-transform data compressed with Huffman
-      if( result )
-      {
-        result = Delta::inverseTransform( decodedData );
-      }
+      result = HuffmanAlgorithm::inflate( source, length, algorithmData, decodedData, true /* deltaTransform */ );
       break;
     }
 
@@ -153,70 +148,156 @@ bool Compress::inflatePacketData( DataSource* source, quint64 length, QList<qint
 
 
 
+/**
+ * Decompress packet data.
+ *
+ * @see inflatePacket()
+ * @param source Data Source where to read compressed bytes from
+ * @param length Number of items to decompress
+ * @param decodedData List where to store the decoded values
+ * @return bool
+ */
+bool Compress::inflatePacketData( DataSource* source, quint64 length, QList<qint64>& decodedData )
+{
+  return inflatePacket<QList<qint64>&>( source, length, decodedData );
+}
+
+
+
+/**
+ * Decompress packet data into an array of 32 bits values.
+ *
+ * @see inflatePacket()
+ * @param source Data Source where to read compressed bytes from
+ * @param length Number of items to decompress
+ * @param decodedData Array with room for [length] values, where to store the decoded values
+ * @return bool
+ */
+bool Compress::inflatePacketData( DataSource* source, quint64 length, qint32* decodedData )
+{
+  return inflatePacket( source, length, decodedData );
+}
+
+
+
+/**
+ * Decompress packet data into an array of 64 bits values.
+ *
+ * @see inflatePacket()
+ * @param source Data Source where to read compressed bytes from
+ * @param length Number of items to decompress
+ * @param decodedData Array with room for [length] values, where to store the decoded values
+ * @return bool
+ */
+bool Compress::inflatePacketData( DataSource* source, quint64 length, qint64* decodedData )
+{
+  return inflatePacket( source, length, decodedData );
+}
+
+
+
 /**
  * Compress packet data.
  *
- * The algorithm to use for the decompression is autodetected
- * by analyzing the data.
+ * The algorithm to use for the compression is chosen by analyzing the data.
+ * With the best compression level, the size of the compressed data is
+ * estimated for Huffman, bit packing, and bit packing of delta-delta
+ * transformed data, and the smallest is used.
  *
  * @param encodedData Byte Array where to store the encoded data
  * @param source List of values to compress
+ * @param level How hard to try to make the compressed data smaller
  * @return bool
  */
-bool Compress::deflatePacketData( QByteArray& encodedData, const QList<qint64>& source )
+bool Compress::deflatePacketData( QByteArray& encodedData, const QList<qint64>& source, CompressionLevel level )
 {
-  bool result;
+  bool result = false;
 
-  // TODO Is this really how to detect the algorithm to use?
-  int algorithm;
-  if( source.count() == 1 )
+  // Both Huffman and bit packing may use the delta-delta transformed values:
+  // the codecs transform them on the fly
+  int     algorithm     = Huffman;
+  bool    useTransform  = true;
+  quint8  algorithmData = 0;
+  quint8  blockSize;
+
+  if( level == CompressionBest )
   {
-    algorithm = BitPacking;
+    // Compare the sizes in bits of all the possible encodings
+    quint64 bestSize;
+    algorithmData = HuffmanAlgorithm::index( source, &bestSize, true /* deltaTransform */ );
+
+    blockSize = BitPackingAlgorithm::blockSize( source );
+    quint64 size = (quint64)blockSize * source.count();
+    if( blockSize < BitPackingTransformMask && size < bestSize )
+    {
+      algorithm     = BitPacking;
+      useTransform  = false;
+      algorithmData = blockSize;
+      bestSize      = size;
+    }
+
+    blockSize = BitPackingAlgorithm::blockSize( source, true /* deltaTransform */ );
+    size = (quint64)blockSize * source.count();
+    if( blockSize < BitPackingTransformMask && size < bestSize )
+    {
+      algorithm     = BitPacking;
+      useTransform  = true;
+      algorithmData = blockSize;
+    }
+  }
+  else if( source.count() == 1
+       && ( blockSize = BitPackingAlgorithm::blockSize( source ) ) < BitPackingTransformMask )
+  {
+    algorithm     = BitPacking;
+    useTransform  = false;
+    algorithmData = blockSize;
+  }
+  else if( level == CompressionNormal )
+  {
+    algorithmData = HuffmanAlgorithm::index( source, 0, true /* deltaTransform */ );
   }
   else
   {
-    algorithm = Huffman;
+    // Use the index which suits the most common data
+    algorithmData = 2;
   }
 
-
   switch( algorithm )
   {
     case BitPacking:
     {
-      quint8 blockSize = BitPackingAlgorithm::blockSize( source );
-
       // Write the data encoding algorithm and block size
-      encodedData.append( blockSize | BitPacking );
+      if( useTransform )
+      {
+        encodedData.append( algorithmData | BitPackingTransformMask | BitPacking );
+      }
+      else
+      {
+        encodedData.append( algorithmData | BitPacking );
+      }
 
 #ifdef ISFQT_DEBUG_VERBOSE
-      qDebug() << "- Deflating" << source.count() << "items using the bit packing algorithm and a block size of" << blockSize;
+      qDebug() << "- Deflating" << source.count() << "items using the bit packing algorithm and a block size of" << algorithmData
+               << ( useTransform ? "(delta-delta transformed)" : "" );
 #endif
 
       // Deflate the data
-      result = BitPackingAlgorithm::deflate( encodedData, blockSize, source );
+      result = BitPackingAlgorithm::deflate( encodedData, algorithmData, source, useTransform );
       break;
     }
 
 
     case Huffman:
     {
-      quint8 index = HuffmanAlgorithm::index( source );
-
       // Write the data encoding algorithm and index
-      encodedData.append( index | Huffman );
+      encodedData.append( algorithmData | Huffman );
 
 #ifdef ISFQT_DEBUG_VERBOSE
-      qDebug() << "- Deflating" << source.count() << "items using the Huffman algorithm and index" << index;
+      qDebug() << "- Deflating" << source.count() << "items using the Huffman algorithm and index" << algorithmData;
 #endif
 
-      // Deflate the data
-      QList<qint64> list( source );
-      result = Delta::transform( list );
-
-      if( result )
-      {
-        result = HuffmanAlgorithm::deflate( encodedData, index, list );
-      }
+      // Deflate the data: Huffman data is always delta-delta transformed
+      result = HuffmanAlgorithm::deflate( encodedData, algorithmData, source, true /* deltaTransform */ );
       break;
     }
 
@@ -254,7 +335,7 @@ bool Compress::inflatePropertyData( DataSource* source, quint64 length, QList<qi
     return false;
   }
 
-  bool    result;
+  bool    result        = false;
   quint8  byte          = source->getByte();
   qint16  algorithm     = ( byte & AlgorithmMask );
   quint8  algorithmData = 0;
@@ -273,6 +354,11 @@ bool Compress::inflatePropertyData( DataSource* source, quint64 length, QList<qi
     qDebug()   << "[Information - type: default, byte:" << QString::number( source->getByte(), 16 ) << "hex]";
     return false;
   }
+  // Limpel-Ziv uses the whole most significant half of the byte
+  else if( algorithm == LimpelZiv )
+  {
+    algorithm = LimpelZiv;
+  }
   // Use the "best compression" algorithm, which is Huffman
   else if( ( algorithm & BestCompression ) == BestCompression
   ||       ( algorithm & Huffman         ) == Huffman )
@@ -280,29 +366,21 @@ bool Compress::inflatePropertyData( DataSource* source, quint64 length, QList<qi
     algorithm = Huffman;
     algorithmData = ( HuffmanMask & byte );
   }
-  else if( ( algorithm & LimpelZiv ) == LimpelZiv )
-  {
-    algorithm = LimpelZiv;
-  }
-  else if( ( algorithm & BitPackingByte ) == BitPackingByte )
+  // The bit packing algorithms are told apart by the first bit which is set
+  else if( ( algorithm & BitPackingLong ) == BitPackingLong )
   {
-    algorithm = BitPackingByte;
-    algorithmData = ( BitPackingByteMask & byte );
+    algorithm = BitPackingLong;
+    algorithmData = ( BitPackingLongMask & byte );
   }
   else if( ( algorithm & BitPackingWord ) == BitPackingWord )
   {
     algorithm = BitPackingWord;
     algorithmData = ( BitPackingWordMask & byte );
   }
-  else if( ( algorithm & BitPackingLong ) == BitPackingLong )
-  {
-    algorithm = BitPackingLong;
-    algorithmData = ( BitPackingLongMask & byte );
-  }
   else
   {
-    // Unknown algorithm. Throw an error below.
-    algorithm = -1;
+    algorithm = BitPackingByte;
+    algorithmData = ( BitPackingByteMask & byte );
   }
 
   // Apply the deflation algorithm
@@ -325,10 +403,7 @@ bool Compress::inflatePropertyData( DataSource* source, quint64 length, QList<qi
       qDebug() << "- Inflating" << length << "bytes using the Bit Packing Word algorithm and an index of" << algorithmData;
 #endif
 
-      qWarning() << "Stream data is compressed with non implemented algorithm!";
-      qDebug()   << "[Information - algorithm: Bit Packing Word]";
-      return false;
-
+      result = BitPackingWordAlgorithm::inflate( source, length, algorithmData, decodedData );
       break;
     }
 
@@ -338,22 +413,17 @@ bool Compress::inflatePropertyData( DataSource* source, quint64 length, QList<qi
       qDebug() << "- Inflating" << length << "bytes using the Bit Packing Long algorithm and an index of" << algorithmData;
 #endif
 
-      qWarning() << "Stream data is compressed with non implemented algorithm!";
-      qDebug()   << "[Information - algorithm: Bit Packing Long]";
-      return false;
-
+      result = BitPackingLongAlgorithm::inflate( source, length, algorithmData, decodedData );
       break;
     }
 
     case LimpelZiv:
     {
 #ifdef ISFQT_DEBUG_VERBOSE
-      qDebug() << "- Inflating" << length << "items using the Limpel-Ziv algorithm and a block size of" << algorithmData;
+      qDebug() << "- Inflating" << length << "bytes using the Limpel-Ziv algorithm";
 #endif
 
-      qWarning() << "Stream data is compressed with non implemented algorithm!";
-      qDebug()   << "[Information - algorithm: Limpel-Ziv]";
-      return false;
+      result = LimpelZivAlgorithm::inflate( source, length, decodedData );
 
       break;
     }
@@ -363,13 +433,8 @@ bool Compress::inflatePropertyData( DataSource* source, quint64 length, QList<qi
 #ifdef ISFQT_DEBUG_VERBOSE
       qDebug() << "- Inflating" << length << "items using the Huffman algorithm and index" << algorithmData;
 #endif
-      result = HuffmanAlgorithm::inflate( source, length, algorithmData, decodedData );
-
       // Always delta-inverse-transform data compressed with Huffman
-      if( result )
-      {
-        result = Delta::inverseTransform( decodedData );
-      }
+      result = HuffmanAlgorithm::inflate( source, length, algorithmData, decodedData, true /* deltaTransform */ );
 
       break;
     }
@@ -398,22 +463,87 @@ bool Compress::inflatePropertyData( DataSource* source, quint64 length, QList<qi
 /**
  * Compress property data.
  *
- * The algorithm to use for the decompression is autodetected
- * by analyzing the data.
+ * The algorithm to use for the compression is chosen by analyzing the data:
+ * values which fit in 8 or 16 bits unsigned integers are packed as bytes or
+ * words, others as 32 bits signed integers. Bytes are compressed with the
+ * Limpel-Ziv algorithm instead, when that gives a smaller output.
  *
- * @todo Implement!
  * @param encodedData Byte Array where to store the encoded data
  * @param source List of values to compress
  * @return bool
  */
 bool Compress::deflatePropertyData( QByteArray& encodedData, const QList<qint64>& source )
 {
-  Q_UNUSED( encodedData );
-  Q_UNUSED( source );
+  bool   result = false;
+  qint64 minimum = 0;
+  qint64 maximum = 0;
 
-  bool result = false;
+  foreach( qint64 value, source )
+  {
+    minimum = qMin( minimum, value );
+    maximum = qMax( maximum, value );
+  }
+
+  if( minimum >= 0 && maximum <= 0xFF )
+  {
+    quint8 index = BitPackingByteAlgorithm::index( source );
+
+    QByteArray packed;
+    packed.append( index | BitPackingByte );
+    result = BitPackingByteAlgorithm::deflate( packed, index, source );
+
+    // Repetitive byte blobs are better compressed with Limpel-Ziv
+    QByteArray compressed;
+    compressed.append( LimpelZiv );
+    if( LimpelZivAlgorithm::deflate( compressed, source )
+    &&  ( ! result || compressed.size() < packed.size() ) )
+    {
+#ifdef ISFQT_DEBUG_VERBOSE
+      qDebug() << "- Deflating" << source.count() << "items using the Limpel-Ziv algorithm";
+#endif
+
+      encodedData.append( compressed );
+      result = true;
+    }
+    else if( result )
+    {
+#ifdef ISFQT_DEBUG_VERBOSE
+      qDebug() << "- Deflating" << source.count() << "items using the Bit Packing Byte algorithm and an index of" << index;
+#endif
+
+      encodedData.append( packed );
+    }
+  }
+  else if( minimum >= 0 && maximum <= 0xFFFF )
+  {
+    quint8 index = BitPackingWordAlgorithm::index( source );
+
+    // Write the data encoding algorithm and index
+    encodedData.append( index | BitPackingWord );
+
+#ifdef ISFQT_DEBUG_VERBOSE
+    qDebug() << "- Deflating" << source.count() << "items using the Bit Packing Word algorithm and an index of" << index;
+#endif
+
+    result = BitPackingWordAlgorithm::deflate( encodedData, index, source );
+  }
+  else if( minimum >= -0x80000000LL && maximum <= 0x7FFFFFFFLL )
+  {
+    quint8 index = BitPackingLongAlgorithm::index( source );
 
-  qWarning() << "Property data saving is not implemented at the moment!";
+    // Write the data encoding algorithm and index
+    encodedData.append( index | BitPackingLong );
+
+#ifdef ISFQT_DEBUG_VERBOSE
+    qDebug() << "- Deflating" << source.count() << "items using the Bit Packing Long algorithm and an index of" << index;
+#endif
+
+    result = BitPackingLongAlgorithm::deflate( encodedData, index, source );
+  }
+  else
+  {
+    qWarning() << "Property data does not fit in 32 bits integers!";
+  }
 
   return result;
 }
@@ -23,6 +23,8 @@
 
 #include "datasource.h"
 
+#include <IsfQt>
+
 
 
 namespace Isf
@@ -115,7 +117,9 @@ namespace Isf
 
 
     bool inflatePacketData( DataSource* source, quint64 length, QList<qint64>& decodedData );
-    bool deflatePacketData( QByteArray& destination, const QList<qint64>& decodedData );
+    bool inflatePacketData( DataSource* source, quint64 length, qint32* decodedData );
+    bool inflatePacketData( DataSource* source, quint64 length, qint64* decodedData );
+    bool deflatePacketData( QByteArray& destination, const QList<qint64>& decodedData, CompressionLevel level = CompressionBest );
 
     bool inflatePropertyData( DataSource* source, quint64 length, QList<qint64>& decodedData );
     bool deflatePropertyData( QByteArray& destination, const QList<qint64>& decodedData );
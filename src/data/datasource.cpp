@@ -23,8 +23,12 @@
 
 #include "datasource.h"
 
+#include "base64.h"
+
 #include "isfqt-internal.h"
 
+#include <QtEndian>
+
 
 using namespace Isf;
 using namespace Isf::Compress;
@@ -35,11 +39,12 @@ using namespace Isf::Compress;
  * Empty constructor.
  */
 DataSource::DataSource()
-: currentBitIndex_( 8 ) // Invalid position in the current byte
+: cache_( 0 )
+, cachePos_( 0 )
+, cacheSize_( 0 )
+, pendingByte_( 0 )
+, pendingBits_( 0 )
 {
-  buffer_.open( QBuffer::ReadWrite );
-
-  currentByte_.resize( 8 );
 }
 
 
@@ -47,19 +52,16 @@ DataSource::DataSource()
 /**
  * Constructor.
  *
- * @param data Byte array to copy and use as data source
+ * @param data Byte array to use as data source
  */
 DataSource::DataSource( const QByteArray& data )
-: currentBitIndex_( 8 )
+: data_( data )
+, cache_( 0 )
+, cachePos_( 0 )
+, cacheSize_( 0 )
+, pendingByte_( 0 )
+, pendingBits_( 0 )
 {
-  buffer_.setData( data );
-  buffer_.open( QBuffer::ReadWrite );
-  buffer_.seek( 0 );
-
-  currentByte_.resize( 8 );
-
-  // Move the first byte of data in the bit array
-  moveByteToBitArray();
 }
 
 
@@ -80,24 +82,7 @@ DataSource::~DataSource()
  */
 void DataSource::append( char byte )
 {
-  bool wasEmpty = ( buffer_.size() == 0 );
-
-  if( ! wasEmpty )
-  {
-    buffer_.seek( buffer_.size() );
-  }
-
-  if( buffer_.write( &byte, 1 ) != 1 )
-  {
-    qWarning() << "DataSource::append() - Write failed at buffer position" << buffer_.pos();
-    return;
-  }
-
-  // Prepare the first byte to be read
-  if( wasEmpty )
-  {
-    currentBitIndex_ = 8;
-  }
+  data_.append( byte );
 }
 
 
@@ -105,11 +90,14 @@ void DataSource::append( char byte )
 /**
  * Insert bits at the end of the data.
  *
- * @param constBits The list of bits to append
+ * Bits which do not fill up a whole byte are kept aside until more bits
+ * are appended, or until flush() is called.
+ *
+ * @param bits The list of bits to append
  */
-void DataSource::append( const QBitArray& constBits )
+void DataSource::append( const QBitArray& bits )
 {
-  if( constBits.size() == 0 )
+  if( bits.size() == 0 )
   {
 #ifdef ISFQT_DEBUG_VERBOSE
     qDebug() << "Not writing an empty bit array, skipping.";
@@ -117,79 +105,9 @@ void DataSource::append( const QBitArray& constBits )
     return;
   }
 
-  if( buffer_.size() != 0 )
+  for( int index = 0; index < bits.size(); ++index )
   {
-    buffer_.seek( buffer_.size() );
-  }
-
-  quint8 initialPos = 0;
-  quint8 size = constBits.size();
-
-  // If there are unwritten bits, add them to the input bit array
-  if( currentBitIndex_ != 8 )
-  {
-    size += currentBitIndex_;
-  }
-
-  QBitArray bits( size );
-
-  // Copy on the input bit array the current byte then the input bits
-  if( currentBitIndex_ != 8 )
-  {
-    initialPos = currentBitIndex_;
-    for( quint8 idx = 0; idx < currentBitIndex_; ++idx )
-    {
-      bits[ idx ] = currentByte_[ idx ];
-    }
-  }
-  for( quint8 idx = 0; idx < constBits.size(); ++idx )
-  {
-    bits[ idx + initialPos ] = constBits[ idx ];
-  }
-
-  quint8 bit = 7;
-  quint8 byte = 0;
-  QByteArray bytes;
-  quint8 byteWiseSize = bits.size() - ( bits.size() % 8 );
-
-  // Skip writing if there are no full bytes
-  if( byteWiseSize != 0 )
-  {
-    for( quint8 idx = 0; idx < byteWiseSize; ++idx )
-    {
-      byte |= bits[ idx ] << bit;
-
-      // A byte was filled, push it to the bytearray
-      if( bit-- == 0 )
-      {
-        bytes.append( byte );
-        bit = 7;
-        byte = 0;
-      }
-    }
-
-    // Write the bytes in the buffer
-    if( bytes.size() > 0 && buffer_.write( bytes ) != bytes.size() )
-    {
-      qWarning() << "DataSource::append() - Write failed at buffer position" << buffer_.pos();
-      return;
-    }
-  }
-
-  // Move any remaining bits to the current byte
-  quint8 remainingBitSize = ( bits.size() - byteWiseSize );
-  if( remainingBitSize > 0 )
-  {
-    for( currentBitIndex_ = 0; currentBitIndex_ < remainingBitSize; ++currentBitIndex_ )
-    {
-      currentByte_[ currentBitIndex_ ] = bits[ currentBitIndex_ + byteWiseSize ];
-    }
-  }
-  else
-  {
-    currentByte_.clear();
-    currentByte_.resize( 8 );
-    currentBitIndex_ = 8;
+    appendBits( bits.at( index ) ? 1 : 0, 1 );
   }
 }
 
@@ -202,24 +120,7 @@ void DataSource::append( const QBitArray& constBits )
  */
 void DataSource::append( const QByteArray& bytes )
 {
-  bool wasEmpty = ( buffer_.size() == 0 );
-
-  if( ! wasEmpty )
-  {
-    buffer_.seek( buffer_.size() );
-  }
-
-  if( buffer_.write( bytes ) != bytes.size() )
-  {
-    qWarning() << "DataSource::append() - Write of" << bytes.size() << "bytes failed at buffer position" << buffer_.pos();
-    return;
-  }
-
-  // Prepare the first byte to be read
-  if( wasEmpty )
-  {
-    currentBitIndex_ = 8;
-  }
+  data_.append( bytes );
 }
 
 
@@ -239,12 +140,11 @@ bool DataSource::atEnd( bool considerBits ) const
 {
   if( considerBits )
   {
-    // There's no more data only when both the buffer AND all the bits
-    // have been read
-    return buffer_.atEnd() && ( currentBitIndex_ >= 8 );
+    // There's no more data only when all the bits have been read
+    return cacheSize_ == 0 && cachePos_ >= data_.size();
   }
 
-  return buffer_.atEnd();
+  return pos() >= data_.size();
 }
 
 
@@ -254,15 +154,9 @@ bool DataSource::atEnd( bool considerBits ) const
  */
 void DataSource::clear()
 {
-  buffer_.close();
-  buffer_.setData( QByteArray() );
-  buffer_.open( QIODevice::ReadWrite );
-  buffer_.seek( 0 );
-
-  currentBitIndex_ = 8;
+  data_.clear();
 
-  currentByte_.clear();
-  currentByte_.resize( 8 );
+  reset();
 }
 
 
@@ -274,7 +168,7 @@ void DataSource::clear()
  */
 const QByteArray& DataSource::data() const
 {
-  return buffer_.data();
+  return data_;
 }
 
 
@@ -287,23 +181,15 @@ const QByteArray& DataSource::data() const
  */
 void DataSource::flush()
 {
-  if( currentBitIndex_ >= 8 )
+  if( pendingBits_ == 0 )
   {
     return;
   }
 
-  quint8 bit = 7;
-  quint8 byte = 0;
-  for( quint8 index = 0; index < currentBitIndex_; ++index )
-  {
-    byte |= currentByte_[ index ] << bit--;
-  }
+  data_.append( (char)( pendingByte_ << ( 8 - pendingBits_ ) ) );
 
-  // Write the bytes in the buffer
-  if( buffer_.write( (char*)&byte, 1 ) != 1 )
-  {
-    qWarning() << "DataSource::flush() - Write failed at buffer position" << buffer_.pos();
-  }
+  pendingByte_ = 0;
+  pendingBits_ = 0;
 }
 
 
@@ -311,182 +197,91 @@ void DataSource::flush()
 /**
  * Retrieve the index of the current bit.
  *
- * @return Current position within the byte we're reading at the moment
+ * @return Current position within the byte we're reading at the moment,
+ *         or 8 if no byte is being read
  */
 quint8 DataSource::getBitIndex()
 {
-  return currentBitIndex_;
-}
-
-
-
-/**
- * Retrieve the next bit from the data.
- *
- * @param ok If set, it will contain whether the call was successful or not.
- * @return bool
- */
-bool DataSource::getBit( bool* ok )
-{
-  if( currentBitIndex_ >= 8 )
-  {
-    // Also check the index again, in case somehow moveByteToBitArray()
-    // fails to move the bit index
-    if( ( ! moveByteToBitArray() ) || currentBitIndex_ >= 8 )
-    {
-      if( ok != nullptr )
-      {
-        *ok = false;
-      }
-      return false;
-    }
-
-    Q_ASSERT( currentBitIndex_ == 0 );
-  }
+  quint8 index = ( 8 - ( cacheSize_ & 7 ) ) & 7;
 
-  Q_ASSERT( currentByte_.size() == 8 );
-
-  if( ok != nullptr )
-  {
-    *ok = true;
-  }
-
-  ++currentBitIndex_;
-
-  return currentByte_.at( currentBitIndex_ - 1 );
+  return ( index == 0 ) ? 8 : index;
 }
 
 
 
 /**
- * Retrieve the next [amount] bits from the data.
+ * Retrieve the next byte from the data
  *
- * @param amount Number of bits to read
  * @param ok If set, it will contain whether the call was successful or not.
- * @return quint64 with the set of read bits
+ * @return char
  */
-quint64 DataSource::getBits( quint8 amount, bool* ok )
+char DataSource::getByte( bool* ok )
 {
-  if( amount > 64 )
+  if( cacheSize_ < 8 )
   {
-    qWarning() << "DataSource:getBits() - Cannot retrieve" << amount << "bits, the maximum is 64 bits!";
+    refill();
 
-    if( ok != nullptr )
+    if( cacheSize_ < 8 )
     {
-      *ok = false;
-    }
-
-    return 0LL;
-  }
-
-  bool gotBitOk = false;
-  quint8 bitIndex = 0;
-  quint64 value = 0;
-
-  while( ! atEnd( true ) && bitIndex < amount )
-  {
-    bool bit = getBit( &gotBitOk );
+      // The remaining bits are discarded anyway
+      cache_     = 0;
+      cacheSize_ = 0;
 
-    if( ! gotBitOk )
-    {
       if( ok != nullptr )
       {
         *ok = false;
       }
 
-      return 0LL;
-    }
-
-    if( bit )
-    {
-#if Q_BYTE_ORDER == Q_BIG_ENDIAN
-      value |= 1 << bitIndex;
-#else
-      value |= 1 << ( amount - bitIndex - 1 );
-#endif
+      return 0;
     }
-
-    ++bitIndex;
   }
 
-  // If more bits must be read, but are not available, abort
-#ifdef ISFQT_DEBUG_VERBOSE
-  if( ( bitIndex < amount ) && atEnd( true ) )
-  {
-    qDebug() << "Unable to read all bits: only" << bitIndex << "of" << amount << "were available.";
-  }
-#endif
+  char byte = (char)( cache_ >> 56 );
+  cache_    <<= 8;
+  cacheSize_ -= 8;
 
   // Done!
   if( ok != nullptr )
   {
     *ok = true;
   }
-
-  return value;
+  return byte;
 }
 
 
 
 /**
- * Retrieve the next byte from the data
+ * Retrieve the next [amount] bytes from the data.
  *
+ * @param amount Number of bytes to read
  * @param ok If set, it will contain whether the call was successful or not.
- * @return char
+ * @return byte array of read bytes
  */
-char DataSource::getByte( bool* ok )
+QByteArray DataSource::getBytes( qint64 amount, bool* ok )
 {
-  bool   gotBitOk;
-  quint8 pos      = 0;
-  qint8  byte     = 0;
-
-  while( pos < 8 )
-  {
-    bool bit = getBit( &gotBitOk );
-
-    if( ! gotBitOk )
-    {
-      if( ok != 0 )
-      {
-        *ok = false;
-      }
-
-      return 0;
-    }
-
-#if Q_BYTE_ORDER == Q_BIG_ENDIAN
-    byte |= ( bit << pos++ );
-#else
-    byte |= ( bit << ( 7 - pos++ ) );
-#endif
-  }
-
-  // Done!
   if( ok != nullptr )
   {
     *ok = true;
   }
-  return byte;
-}
 
+  // When reading whole bytes, copy them straight from the buffer
+  if( ( cacheSize_ & 7 ) == 0 )
+  {
+    qint64 position = pos();
+    qint64 length   = qMin<qint64>( amount, data_.size() - position );
 
+    seek( position + length );
+
+    return data_.mid( position, length );
+  }
 
-/**
- * Retrieve the next [amount] bytes from the data.
- *
- * @param amount Number of bytes to read
- * @param ok If set, it will contain whether the call was successful or not.
- * @return byte array of read bytes
- */
-QByteArray DataSource::getBytes( quint8 amount, bool* ok )
-{
   QByteArray bytes;
   bool       gotByteOk;
-  quint8     index     = 0;
+  qint64     index     = 0;
 
   while( ! atEnd() && index < amount )
   {
-    quint8 byte = getByte( &gotByteOk );
+    char byte = getByte( &gotByteOk );
 
     if( ! gotByteOk )
     {
@@ -502,60 +297,40 @@ QByteArray DataSource::getBytes( quint8 amount, bool* ok )
     ++index;
   }
 
-  // Done!
-  if( ok != nullptr )
-  {
-    *ok = true;
-  }
-
   return bytes;
 }
 
 
 
 /**
- * Move a byte from the buffer into the 'current byte' bit array.
+ * Get some bytes from the buffer, without copying them.
  *
- * @return bool
+ * The returned array points straight into the buffer, so it is only valid
+ * as long as the buffer is. Bytes which are not aligned to the buffer's
+ * bytes can't be pointed to, and are copied like getBytes() does.
+ *
+ * @param amount The number of bytes to retrieve
+ * @param ok Set to false if there were not enough bytes
+ * @return The retrieved bytes
  */
-bool DataSource::moveByteToBitArray()
+QByteArray DataSource::getRawBytes( qint64 amount, bool* ok )
 {
-  quint8 byte = 0;
-
-  if( buffer_.size() == 0 )
-  {
-    qWarning() << "DataSource:moveByteToBitArray() - The buffer is empty!";
-    currentByte_.clear();
-    currentBitIndex_ = 8;
-    return false;
-  }
-
-  if( buffer_.atEnd() )
+  if( ( cacheSize_ & 7 ) != 0 )
   {
-    qWarning() << "DataSource:moveByteToBitArray() - The buffer was completely parsed!";
-    currentByte_.clear();
-    currentBitIndex_ = 8;
-    return false;
+    return getBytes( amount, ok );
   }
 
-  if( buffer_.getChar( (char*)&byte ) != 1 )
+  if( ok != nullptr )
   {
-    qWarning() << "DataSource::moveByteToBitArray() - Read failed at buffer position" << buffer_.pos();
-    return false;
+    *ok = true;
   }
 
-  for( qint8 i = 0; i < 8; i++ )
-  {
-#if Q_BYTE_ORDER == Q_BIG_ENDIAN
-    currentByte_.setBit( i, byte & ( 1 << i ) );
-#else
-    currentByte_.setBit( 7 - i, byte & ( 1 << i ) );
-#endif
-  }
+  qint64 position = pos();
+  qint64 length   = qMin<qint64>( amount, data_.size() - position );
 
-  currentBitIndex_ = 0;
+  seek( position + length );
 
-  return true;
+  return QByteArray::fromRawData( data_.constData() + position, (int)length );
 }
 
 
@@ -563,11 +338,13 @@ bool DataSource::moveByteToBitArray()
 /**
  * Get the current position within the internal data buffer.
  *
+ * A partially read byte counts as read.
+ *
  * @return qint64
  */
 qint64 DataSource::pos() const
 {
-  return buffer_.pos();
+  return cachePos_ - ( cacheSize_ >> 3 );
 }
 
 
@@ -579,16 +356,10 @@ qint64 DataSource::pos() const
  */
 void DataSource::prepend( char byte )
 {
-  buffer_.buffer().prepend( byte );
-
-  bool wasAtBeginning = ( buffer_.pos() == 0 );
+  data_.prepend( byte );
 
-  seekRelative( 1 );
-
-  if( wasAtBeginning )
-  {
-    moveByteToBitArray();
-  }
+  // Keep reading from the same byte as before
+  ++cachePos_;
 }
 
 
@@ -600,16 +371,54 @@ void DataSource::prepend( char byte )
  */
 void DataSource::prepend( const QByteArray& bytes )
 {
-  buffer_.buffer().prepend( bytes );
+  data_.prepend( bytes );
+
+  // Keep reading from the same byte as before
+  cachePos_ += bytes.size();
+}
+
 
-  bool wasAtBeginning = ( buffer_.pos() == 0 );
 
-  seekRelative( bytes.size() );
+/**
+ * Fill up the read cache with as many bytes as possible.
+ *
+ * When at least 8 bytes are left, a whole word is read at once: the
+ * cache then holds at least 56 valid bits. Any bits past the valid
+ * ones are either zero or the same bits the next refill will load.
+ */
+void DataSource::refill()
+{
+  const qint64 size = data_.size();
+  const uchar* bytes = reinterpret_cast<const uchar*>( data_.constData() );
 
-  if( wasAtBeginning )
+  if( cachePos_ + 8 <= size )
   {
-    moveByteToBitArray();
+    cache_     |= qFromBigEndian<quint64>( bytes + cachePos_ ) >> cacheSize_;
+    cachePos_  += ( 63 - cacheSize_ ) >> 3;
+    cacheSize_ |= 56;
+    return;
   }
+
+  // Near the end of the buffer, go one byte at a time
+  while( cacheSize_ <= 56 && cachePos_ < size )
+  {
+    cache_     |= (quint64)bytes[ cachePos_++ ] << ( 56 - cacheSize_ );
+    cacheSize_ += 8;
+  }
+}
+
+
+
+/**
+ * Make room for the given total amount of bytes.
+ *
+ * Appending up to that amount will not need to grow the buffer again.
+ *
+ * @param size Bytes the buffer will hold
+ */
+void DataSource::reserve( qint64 size )
+{
+  data_.reserve( size );
 }
 
 
@@ -620,8 +429,24 @@ void DataSource::prepend( const QByteArray& bytes )
  */
 void DataSource::reset()
 {
-  buffer_.reset();
-  currentBitIndex_ = 8;
+  seek( 0 );
+
+  pendingByte_ = 0;
+  pendingBits_ = 0;
+}
+
+
+
+/**
+ * Move the read position to a byte within the buffer.
+ *
+ * @param pos Absolute position where to move
+ */
+void DataSource::seek( qint64 pos )
+{
+  cache_     = 0;
+  cachePos_  = pos;
+  cacheSize_ = 0;
 }
 
 
@@ -630,20 +455,23 @@ void DataSource::reset()
 /**
  * Seek back and forth in the stream.
  *
- * A negative pos will move backwards within the stream.
+ * A negative pos will move backwards within the stream. Any partially
+ * read byte is skipped.
  *
  * @param pos Relative position where to move
  */
 void DataSource::seekRelative( int pos )
 {
-  if( pos < 0 && buffer_.pos() <= 0 )
+  qint64 current = this->pos();
+
+  if( pos < 0 && ( current + pos ) < 0 )
   {
 #ifdef ISFQT_DEBUG_VERBOSE
     qWarning() << "Cannot seek back!";
 #endif
     return;
   }
-  if( pos > 0 && ( buffer_.size() - buffer_.pos() ) < pos )
+  if( pos > 0 && ( data_.size() - current ) < pos )
   {
 #ifdef ISFQT_DEBUG_VERBOSE
     qWarning() << "Cannot seek forward!";
@@ -651,7 +479,7 @@ void DataSource::seekRelative( int pos )
     return;
   }
 
-  buffer_.seek( buffer_.pos() + pos );
+  seek( current + pos );
 }
 
 
@@ -659,16 +487,28 @@ void DataSource::seekRelative( int pos )
 /**
  * Replace the data byte array with another.
  *
- * @param data New array to copy and use as the data source
+ * Base64 data is decoded in a single pass, straight into the data buffer.
+ *
+ * @param data New array to use as the data source
+ * @param decodeFromBase64 Whether the data is in the Base64 format and
+ *                         needs to be decoded
  */
-void DataSource::setData( const QByteArray& data )
+void DataSource::setData( const QByteArray& data, bool decodeFromBase64 )
 {
-  buffer_.close();
-  buffer_.setData( data );
-  buffer_.open( QIODevice::ReadWrite );
-  buffer_.seek( 0 );
+  if( decodeFromBase64 )
+  {
+    Base64Decoder decoder;
 
-  currentBitIndex_ = 8;
+    data_.clear();
+    data_.resize( Base64Decoder::maximumDecodedSize( data.size() ) );
+    data_.resize( decoder.decode( data.constData(), data.size(), data_.data() ) );
+  }
+  else
+  {
+    data_ = data;
+  }
+
+  reset();
 }
 
 
@@ -682,12 +522,10 @@ void DataSource::setData( const QByteArray& data )
  */
 void DataSource::skipToNextByte()
 {
-  if( currentBitIndex_ == 0 )
-  {
-    return;
-  }
+  quint8 remainingBits = ( cacheSize_ & 7 );
 
-  moveByteToBitArray();
+  cache_    <<= remainingBits;
+  cacheSize_ -= remainingBits;
 }
 
 
@@ -701,7 +539,7 @@ void DataSource::skipToNextByte()
  */
 void DataSource::skipToPrevByte()
 {
-  currentBitIndex_ = 8;
+  skipToNextByte();
 }
 
 
@@ -714,7 +552,5 @@ void DataSource::skipToPrevByte()
  */
 qint64 DataSource::size() const
 {
-  return buffer_.size();
+  return data_.size();
 }
-
-
@@ -25,7 +25,8 @@
 #define DATASOURCE_H
 
 #include <QBitArray>
-#include <QBuffer>
+#include <QByteArray>
+#include <QtDebug>
 
 
 
@@ -35,11 +36,15 @@ namespace Isf
   {
     /**
      * @class DataSource
-     * @brief Class to handle a QBuffer at the bit level.
+     * @brief Class to handle a byte array at the bit level.
      *
      * You can use this class in two ways: first, reading and writing bytes
      * normally. Second, reading and writing individual bits.
      *
+     * Reading is done through a 64-bit cache which is refilled from the
+     * byte array a whole word at a time, so that bits can be extracted with
+     * shifts and masks instead of one by one.
+     *
      * Warning: Mixing up the usage modes is not very well tested!
      */
     class DataSource
@@ -60,36 +65,237 @@ namespace Isf
         void              append( char byte );
         void              append( const QBitArray& bits );
         void              append( const QByteArray& bytes );
+        void              appendBits( quint64 bits, quint8 amount );
         void              clear();
         void              flush();
         bool              getBit( bool* ok = 0 );
         quint64           getBits( quint8 amount, bool* ok = 0 );
         quint8            getBitIndex();
         char              getByte( bool* ok = 0 );
-        QByteArray        getBytes( quint8 amount, bool* ok = 0 );
+        QByteArray        getBytes( qint64 amount, bool* ok = 0 );
+        QByteArray        getRawBytes( qint64 amount, bool* ok = 0 );
+        quint64           peekBits( quint8 amount );
         void              prepend( char byte );
         void              prepend( const QByteArray& bytes );
+        void              reserve( qint64 size );
         void              reset();
-        void              setData( const QByteArray& data );
+        void              setData( const QByteArray& data, bool decodeFromBase64 = false );
         void              seekRelative( int pos );
+        void              skipBits( quint8 amount );
         void              skipToNextByte();
         void              skipToPrevByte();
 
       private: // Private methods
-        bool              moveByteToBitArray();
+        void              refill();
+        void              seek( qint64 pos );
 
       private: // Private properties
         /// Main data buffer
-        QBuffer           buffer_;
-        /// Current bit within the bit array
-        quint8            currentBitIndex_;
-        /// Current byte
-        QBitArray         currentByte_;
+        QByteArray        data_;
+        /// Bits read in advance from the buffer, most significant bit first
+        quint64           cache_;
+        /// Position of the next byte of the buffer to move into the cache
+        qint64            cachePos_;
+        /// Number of valid bits in the cache
+        quint8            cacheSize_;
+        /// Appended bits which do not fill a whole byte yet
+        quint8            pendingByte_;
+        /// Number of valid bits in the pending byte
+        quint8            pendingBits_;
 
     };
 
 
 
+    /**
+     * Insert the [amount] least significant bits of a value at the end of
+     * the data, most significant bit first.
+     *
+     * Whole bytes are written to the buffer straight away; the leftover bits
+     * are kept until more bits are appended, or until flush() is called.
+     *
+     * @param bits Value to append
+     * @param amount Number of bits of the value to append, up to 64
+     */
+    inline void DataSource::appendBits( quint64 bits, quint8 amount )
+    {
+      if( amount > 56 )
+      {
+        appendBits( bits >> 32, amount - 32 );
+        appendBits( bits, 32 );
+        return;
+      }
+
+      // Merge the new bits with the pending ones, then write all whole bytes
+      quint64 accumulator = ( (quint64)pendingByte_ << amount )
+                          | ( bits & ( ( Q_UINT64_C( 1 ) << amount ) - 1 ) );
+      quint8  size        = pendingBits_ + amount;
+
+      while( size >= 8 )
+      {
+        size -= 8;
+        data_.append( (char)( accumulator >> size ) );
+      }
+
+      pendingByte_ = accumulator & ( ( 1 << size ) - 1 );
+      pendingBits_ = size;
+    }
+
+
+
+    /**
+     * Retrieve the next bit from the data.
+     *
+     * @param ok If set, it will contain whether the call was successful or not.
+     * @return bool
+     */
+    inline bool DataSource::getBit( bool* ok )
+    {
+      if( cacheSize_ == 0 )
+      {
+        refill();
+
+        if( cacheSize_ == 0 )
+        {
+          if( ok != nullptr )
+          {
+            *ok = false;
+          }
+          return false;
+        }
+      }
+
+      if( ok != nullptr )
+      {
+        *ok = true;
+      }
+
+      bool bit = ( cache_ >> 63 );
+      cache_ <<= 1;
+      --cacheSize_;
+
+      return bit;
+    }
+
+
+
+    /**
+     * Retrieve the next [amount] bits from the data.
+     *
+     * If less than [amount] bits are left, the available bits are returned
+     * as the most significant ones, and the missing bits are set to zero.
+     *
+     * @param amount Number of bits to read
+     * @param ok If set, it will contain whether the call was successful or not.
+     * @return quint64 with the set of read bits
+     */
+    inline quint64 DataSource::getBits( quint8 amount, bool* ok )
+    {
+      // The cache always holds at least 56 bits after a refill: wider
+      // reads are done in two steps
+      if( amount > 56 )
+      {
+        if( amount > 64 )
+        {
+          qWarning() << "DataSource:getBits() - Cannot retrieve" << amount << "bits, the maximum is 64 bits!";
+
+          if( ok != nullptr )
+          {
+            *ok = false;
+          }
+
+          return 0LL;
+        }
+
+        quint64 high = getBits( amount - 32 );
+        return ( high << 32 ) | getBits( 32, ok );
+      }
+
+      if( ok != nullptr )
+      {
+        *ok = true;
+      }
+
+      if( amount == 0 )
+      {
+        return 0LL;
+      }
+
+      if( cacheSize_ < amount )
+      {
+        refill();
+
+        // Not enough data left: return what's there
+        if( cacheSize_ < amount )
+        {
+          quint64 value = cache_ >> ( 64 - amount );
+          cache_     = 0;
+          cacheSize_ = 0;
+          return value;
+        }
+      }
+
+      quint64 value = cache_ >> ( 64 - amount );
+      cache_    <<= amount;
+      cacheSize_ -= amount;
+
+      return value;
+    }
+
+
+
+    /**
+     * Retrieve the next [amount] bits from the data, without consuming them.
+     *
+     * Up to 56 bits can be looked at. Like getBits(), if less than [amount]
+     * bits are left, the missing bits are set to zero.
+     *
+     * @param amount Number of bits to look at
+     * @return quint64 with the set of bits
+     */
+    inline quint64 DataSource::peekBits( quint8 amount )
+    {
+      Q_ASSERT( amount > 0 && amount <= 56 );
+
+      if( cacheSize_ < amount )
+      {
+        refill();
+      }
+
+      return cache_ >> ( 64 - amount );
+    }
+
+
+
+    /**
+     * Discard the next [amount] bits of the data.
+     *
+     * Meant to be used after peekBits(), to consume the bits which have been
+     * looked at.
+     *
+     * @param amount Number of bits to skip, up to 56
+     */
+    inline void DataSource::skipBits( quint8 amount )
+    {
+      if( cacheSize_ < amount )
+      {
+        refill();
+
+        // Not enough data left: skip everything
+        if( cacheSize_ < amount )
+        {
+          cache_     = 0;
+          cacheSize_ = 0;
+          return;
+        }
+      }
+
+      cache_    <<= amount;
+      cacheSize_ -= amount;
+    }
+
+
+
   }
 }
 
@@ -59,6 +59,45 @@ quint64 Compress::decodeUInt( DataSource* source )
 
 
 
+/**
+ * Decodes an unsigned integer straight from a byte array, if it is all there.
+ *
+ * Used to look at streams which are not complete yet.
+ *
+ * @param data Bytes where to read the value from
+ * @param pos Position of the value; on success, moved past it
+ * @param value Decoded value
+ * @return bool False if the data ends before the value does
+ */
+bool Compress::peekUInt( const QByteArray& data, qint64& pos, quint64& value )
+{
+  quint8  count = 0;
+  qint64  index = pos;
+
+  value = 0;
+
+  while( index < data.size() )
+  {
+    quint8 byte = data.at( index++ );
+
+    if( count < 64 )
+    {
+      value |= (quint64)( byte & 0x7F ) << count;
+      count += 7;
+    }
+
+    if( ! ( byte & 0x80 ) )
+    {
+      pos = index;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+
+
 /**
  * Decodes a signed integer into a qint64 using multibyte decoding.
  *
@@ -38,6 +38,7 @@ namespace Isf
     quint64    decodeUInt( DataSource* source );
     qint64     decodeInt( DataSource* source );
     float      decodeFloat( DataSource* source );
+    bool       peekUInt( const QByteArray& data, qint64& pos, quint64& value );
 
     QByteArray encodeUInt( quint64 value );
     void       encodeUInt( DataSource* source, quint64 value, bool prepend = false );
@@ -530,7 +530,7 @@ void InkCanvas::resizeEvent( QResizeEvent* event )
 
 void InkCanvas::save( QIODevice &dev, bool base64 )
 {
-  dev.write( Isf::Stream::writer( *drawing_, base64 ) );
+  Isf::Stream::writer( *drawing_, dev, base64 );
 }
 
 
@@ -28,6 +28,12 @@
 
 #include <IsfQt>
 
+#include <QHash>
+#include <QMutex>
+#include <QPixmap>
+#include <QSharedData>
+#include <QSharedPointer>
+#include <QUuid>
 #include <QtDebug>
 
 
@@ -178,24 +184,118 @@ namespace Isf
 
 
 
+  /**
+   * A stroke found in the stream, whose points are still to be decompressed
+   */
+  struct PendingStroke
+  {
+    /// Whether the stroke contains pressure information or not
+    bool                       hasPressureData;
+    /// The compressed points. While parsing, they point straight into the stream
+    QByteArray                 payload;
+    /// The stroke which will receive the points
+    Stroke*                    stroke;
+  };
+
+
+
+  /**
+   * Implicitly shared data of a Drawing
+   *
+   * The rendering cache only depends on the strokes, so it is shared as well
+   * and can be updated without detaching the data from other copies. Copies
+   * can be painted from different threads, so the cache has its own lock.
+   */
+  struct DrawingData : public QSharedData
+  {
+    DrawingData();
+    DrawingData( const DrawingData& );
+   ~DrawingData();
+
+    void                       destroyStroke( Stroke* );
+    void                       inflate( Stroke* = 0 ) const;
+    QRect                      strokesBoundingRect( const QList<Stroke*>& ) const;
+
+    /// Bounding rectangle of the drawing, set once the strokes are all decompressed
+    mutable QRect              boundingRect;
+    /// Guards the rendering cache: cacheRect, cachePixmap, changedStrokes and dirty
+    mutable QMutex             cacheMutex;
+    /// Cached bounding rectangle
+    mutable QRect              cacheRect;
+    /// The cached pixmap
+    mutable QPixmap            cachePixmap;
+    /// Virtual drawing canvas dimensions
+    QRect                      canvas;
+    /// A list of strokes that need to be repainted.
+    mutable QList<Stroke*>     changedStrokes;
+    /// Is the drawing dirty? i.e, requires repainting?
+    mutable bool               dirty;
+    /// Last parsing error (if there is one), also set when decompressing lazily
+    mutable IsfError           error;
+    /// List of registered GUIDs
+    QList<QUuid>               guids;
+    /// Whether the drawing contains X coordinates or not
+    bool                       hasXData;
+    /// Whether the drawing contains Y coordinates or not
+    bool                       hasYData;
+    /// Guards the decompression of the pending strokes, which copies may share
+    mutable QMutex             inflateMutex;
+    /// Whether the drawing is invalid or valid
+    bool                       isNull;
+    /// Maximum GUID available in the drawing
+    quint64                    maxGuid;
+    /// Maximum thickness of the strokes
+    QSizeF                     maxPenSize;
+    /// Strokes loaded lazily, whose points are still to be decompressed
+    mutable QHash<const Stroke*,PendingStroke> pendingStrokes;
+    /// List of strokes composing this drawing
+    QList<Stroke*>             strokes;
+  };
+
+
+
   /**
    * Internal parser data
    */
   struct StreamData
   {
     StreamData()
-    : currentAttributeSetIndex( 0 )
+    : compressionLevel( CompressionNormal )
+    , currentAttributeSetIndex( 0 )
     , currentMetricsIndex( 0 )
     , currentStrokeInfoIndex( 0 )
     , currentTransformsIndex( 0 )
     , dataSource( 0 )
+    , lazyLoading( false )
+    {
+    }
+
+    /// Forget the data of the last stream, to start over with another one
+    void reset()
     {
+      attributeSets.clear();
+      boundingRect = QRect();
+      compressionLevel = CompressionNormal;
+      currentAttributeSetIndex = 0;
+      currentMetricsIndex = 0;
+      currentStrokeInfoIndex = 0;
+      currentTransformsIndex = 0;
+      lazyLoading = false;
+      metrics.clear();
+      pendingStrokes.clear();
+      sharedMetrics.clear();
+      sharedTransforms.clear();
+      strokeInfos.clear();
+      strokesData.clear();
+      transforms.clear();
     }
 
     /// List of attributes of the points in the drawing
     QList<AttributeSet>        attributeSets;
     /// Drawing's bounding rectangle
     QRect                      boundingRect;
+    /// How hard the writer should try to compress data
+    CompressionLevel           compressionLevel;
     /// Current attribute set
     quint64                    currentAttributeSetIndex;
     /// Current metrics set
@@ -206,11 +306,21 @@ namespace Isf
     quint64                    currentTransformsIndex;
     /// Raw bytes source used to read and write streams
     Compress::DataSource*      dataSource;
-    /// List of metrics used in the drawing
+    /// Whether to leave the strokes compressed until they are needed
+    bool                       lazyLoading;
+    /// List of metrics used in the drawing, when writing
     QList<Metrics*>            metrics;
+    /// Strokes whose points are still to be decompressed
+    QList<PendingStroke>       pendingStrokes;
+    /// List of metrics read by the parser, shared with the strokes which use them
+    QList<QSharedPointer<Metrics> > sharedMetrics;
+    /// Transformation matrices read by the parser, shared with the strokes which use them
+    QList<QSharedPointer<QMatrix> > sharedTransforms;
     /// List of stroke info
-    QList<StrokeInfo*>         strokeInfos;
-    /// Transformation matrices
+    QList<StrokeInfo>          strokeInfos;
+    /// Tags and compressed points of the strokes still to be written
+    QVector<QByteArray>        strokesData;
+    /// Transformation matrices, when writing
     QList<QMatrix*>            transforms;
   };
 
@@ -23,15 +23,25 @@
 
 #include "isfqt-internal.h"
 
+#include "data/base64.h"
 #include "data/datasource.h"
 #include "data/multibytecoding.h"
+#include "parallel.h"
 #include "tagsparser.h"
 #include "tagswriter.h"
 
 #include <IsfQtDrawing>
 
+#include <QAtomicInt>
+#include <QBuffer>
+#include <QFile>
+#include <QIODevice>
+#include <QMetaType>
 #include <QPainter>
 #include <QPixmap>
+#include <QVector>
+
+#include <limits>
 
 #if ISFQT_GIF_ENABLED == 1
   #include "gif-support.h"
@@ -45,9 +55,34 @@ using namespace Compress;
 /// Supported ISF version number
 #define SUPPORTED_ISF_VERSION       0
 
+/// Devices are read this many bytes at a time
+#define DEVICE_READ_CHUNK_SIZE      ( 64 * 1024 )
+
+/// How long to wait for more data from a device, in milliseconds
+#define DEVICE_READ_TIMEOUT         30000
+
+
+
+/**
+ * Create a decoder.
+ */
+Decoder::Decoder()
+: lazyLoading_( false )
+, streamData_( new StreamData() )
+{
+  streamData_->dataSource = new DataSource();
+}
+
 
-// Initialization of static properties
-StreamData* Stream::streamData_( nullptr );
+
+/**
+ * Destructor
+ */
+Decoder::~Decoder()
+{
+  delete streamData_->dataSource;
+  delete streamData_;
+}
 
 
 
@@ -56,29 +91,32 @@ StreamData* Stream::streamData_( nullptr );
  *
  * If the ISF data is invalid, a null Drawing is returned.
  *
+ * The stream is parsed in place, without copying it: bytes borrowed with
+ * QByteArray::fromRawData() only need to stay valid until this returns.
+ * Base64 text is decoded whole first, in a single pass, since the strokes
+ * may be loaded lazily from it.
+ *
  * @param rawData Source byte array with an ISF stream
  * @param decodeFromBase64 Whether the bytes are in the Base64 format and
  *                         need to be decoded first
  * @return an Isf::Drawing, with null contents on error
  */
-Drawing& Stream::reader( const QByteArray& rawData, bool decodeFromBase64 )
+Drawing Decoder::decode( const QByteArray& rawData, bool decodeFromBase64 )
 {
-  // Create a new drawing on the heap to ensure it will keep
-  // living after this method returns
-  Drawing* drawing = new Drawing();
+  // The drawing is moved out to the caller, and its data is never copied
+  Drawing drawing;
 
   ParserState state = ISF_PARSER_START;
 
-  streamData_ = new StreamData();
-  streamData_->dataSource = new DataSource( decodeFromBase64
-                                            ? QByteArray::fromBase64( rawData )
-                                            : rawData );
+  streamData_->reset();
+  streamData_->lazyLoading = lazyLoading_;
+  streamData_->dataSource->setData( rawData, decodeFromBase64 );
 
   int size = streamData_->dataSource->size();
   if( size == 0 )
   {
     state = ISF_PARSER_FINISH;
-    drawing->error_ = ISF_ERROR_BAD_STREAMSIZE;
+    drawing.d_->error = ISF_ERROR_BAD_STREAMSIZE;
   }
 
   while( state != ISF_PARSER_FINISH )
@@ -94,8 +132,8 @@ Drawing& Stream::reader( const QByteArray& rawData, bool decodeFromBase64 )
 #endif
         if ( version != SUPPORTED_ISF_VERSION )
         {
-          drawing->error_ = ISF_ERROR_BAD_VERSION;
-          drawing->isNull_ = true;
+          drawing.d_->error = ISF_ERROR_BAD_VERSION;
+          drawing.d_->isNull = true;
           state = ISF_PARSER_FINISH;
         }
         else
@@ -120,7 +158,7 @@ Drawing& Stream::reader( const QByteArray& rawData, bool decodeFromBase64 )
                    << ", expected" << ( streamData_->dataSource->size() - streamData_->dataSource->pos() );
 #endif
           // streamsize is bad.
-          drawing->error_ = ISF_ERROR_BAD_STREAMSIZE;
+          drawing.d_->error = ISF_ERROR_BAD_STREAMSIZE;
           state = ISF_PARSER_FINISH;
         }
         else
@@ -129,7 +167,7 @@ Drawing& Stream::reader( const QByteArray& rawData, bool decodeFromBase64 )
           qDebug() << "Reading ISF stream of size:" << streamSize << "...";
 #endif
           // Validate the drawing
-          drawing->isNull_ = false;
+          drawing.d_->isNull = false;
 
           // start looking for ISF tags.
           state = ISF_PARSER_TAG;
@@ -147,9 +185,9 @@ Drawing& Stream::reader( const QByteArray& rawData, bool decodeFromBase64 )
         }
 
         // Read the next tag from the stream
-        drawing->error_ = TagsParser::nextTag( streamData_, drawing );
+        drawing.d_->error = TagsParser::nextTag( streamData_, &drawing );
 
-        if( drawing->error_ != ISF_ERROR_NONE )
+        if( drawing.d_->error != ISF_ERROR_NONE )
         {
 #ifdef ISFQT_DEBUG_VERBOSE
           qWarning() << "Error in last operation, stopping.";
@@ -168,27 +206,558 @@ Drawing& Stream::reader( const QByteArray& rawData, bool decodeFromBase64 )
   }
 
 #ifdef ISFQT_DEBUG
-  qDebug() << "Finished with" << ( drawing->error_ == ISF_ERROR_NONE ? "success" : "error" );
+  qDebug() << "Finished with" << ( drawing.d_->error == ISF_ERROR_NONE ? "success" : "error" );
   qDebug();
 #endif
 
-  delete streamData_->dataSource;
+  // Now that all the tags are known, decompress the strokes (or keep them
+  // for later, when loading lazily)
+  IsfError strokesError = TagsParser::inflateStrokes( streamData_, &drawing );
+  if( drawing.d_->error == ISF_ERROR_NONE )
+  {
+    drawing.d_->error = strokesError;
+  }
+
+  // Don't hold on to the stream bytes and the parser data
+  streamData_->dataSource->clear();
+  streamData_->reset();
 
-  if( drawing->error_ != ISF_ERROR_NONE )
+  if( drawing.d_->error != ISF_ERROR_NONE )
   {
-    delete streamData_;
-    streamData_ = 0;
-    return *drawing;
+    return drawing;
   }
 
 #ifdef ISFQT_DEBUG_VERBOSE
-  qDebug() << "Drawing bounding rectangle:" << drawing->boundingRect();
-  qDebug() << "Maximum thickness:" << drawing->maxPenSize_;
+  qDebug() << "Drawing bounding rectangle:" << drawing.boundingRect();
+  qDebug() << "Maximum thickness:" << drawing.d_->maxPenSize;
 #endif
 
+  return drawing;
+}
+
+
+
+/**
+ * Return whether the strokes are decompressed only when they are needed.
+ *
+ * @return bool
+ */
+bool Decoder::lazyLoading() const
+{
+  return lazyLoading_;
+}
+
+
+
+/**
+ * Change whether the strokes are decompressed only when they are needed.
+ *
+ * Lazily loaded drawings decompress a stroke's points when the stroke is
+ * first retrieved, and all of them when the whole drawing is needed: to
+ * get its bounding rectangle, to render it, or to list its strokes.
+ *
+ * @param enabled If true, the next drawings are loaded lazily
+ */
+void Decoder::setLazyLoading( bool enabled )
+{
+  lazyLoading_ = enabled;
+}
+
+
+
+/**
+ * Convert a raw ISF data stream into a drawing.
+ *
+ * If the ISF data is invalid, a null Drawing is returned.
+ *
+ * Base64 text is decoded a piece at a time while the stream is parsed, like
+ * when reading from a device, so the decoded stream is never kept whole.
+ *
+ * @see Decoder
+ * @param rawData Source byte array with an ISF stream
+ * @param decodeFromBase64 Whether the bytes are in the Base64 format and
+ *                         need to be decoded first
+ * @return an Isf::Drawing, with null contents on error
+ */
+Drawing Stream::reader( const QByteArray& rawData, bool decodeFromBase64 )
+{
+  if( decodeFromBase64 )
+  {
+    // The buffer shares the text, it doesn't copy it
+    QBuffer buffer;
+    buffer.setData( rawData );
+    buffer.open( QIODevice::ReadOnly );
+
+    return reader( buffer, true );
+  }
+
+  Decoder decoder;
+  return decoder.decode( rawData );
+}
+
+
+
+/**
+ * Read a drawing from a device which contains a raw ISF data stream.
+ *
+ * The device is read a piece at a time until the stream is over, so only
+ * the drawing and a small buffer are kept in memory. Sequential devices,
+ * like sockets, are waited on when no data is available.
+ *
+ * Nothing past the end of the stream is read: the header is read a byte (or
+ * a Base64 character) at a time, then only the bytes still missing from the
+ * stream. Any data which follows the stream is left in the device.
+ *
+ * Files are memory-mapped instead, and the stream is parsed in place
+ * without reading it at all.
+ *
+ * @see IncrementalDecoder
+ * @param device Device where to read the stream from, already open
+ * @param decodeFromBase64 Whether the bytes are in the Base64 format and
+ *                         need to be decoded first
+ * @return an Isf::Drawing, with null contents on error
+ */
+Drawing Stream::reader( QIODevice& device, bool decodeFromBase64 )
+{
+  QFile* file = qobject_cast<QFile*>( &device );
+  if( file != 0 && ! decodeFromBase64 )
+  {
+    const qint64 start = file->pos();
+    const qint64 size  = file->size() - start;
+
+    uchar* map = 0;
+    if( size > 0 && size <= std::numeric_limits<int>::max() )
+    {
+      map = file->map( start, size );
+    }
+
+    if( map != 0 )
+    {
+      const QByteArray mapped( QByteArray::fromRawData( (const char*)map, (int)size ) );
+
+      // Only parse up to the end of the stream, like with other devices
+      qint64  length = size;
+      qint64  pos    = 0;
+      quint64 version, streamSize;
+      if( peekUInt( mapped, pos, version ) && peekUInt( mapped, pos, streamSize )
+      &&  streamSize <= (quint64)( size - pos ) )
+      {
+        length = pos + streamSize;
+      }
+
+      Decoder decoder;
+      Drawing drawing( decoder.decode( QByteArray::fromRawData( (const char*)map, (int)length ) ) );
+
+      file->unmap( map );
+      file->seek( start + length );
+
+      return drawing;
+    }
+  }
+
+  IncrementalDecoder decoder;
+
+  // Keeps the Base64 characters which don't make a whole byte yet
+  Base64Decoder base64;
+
+  while( ! decoder.isFinished() )
+  {
+    const qint64 missing = decoder.bytesMissing();
+
+    qint64 readSize = DEVICE_READ_CHUNK_SIZE;
+    if( missing < 0 )
+    {
+      readSize = 1;
+    }
+    else if( decodeFromBase64 )
+    {
+      // Each character holds 6 bits. Up to 6 bits of the next byte may
+      // already be kept by the Base64 decoder, so this never reads too much
+      readSize = qMin( readSize, ( missing * 8 - 1 ) / 6 );
+    }
+    else
+    {
+      readSize = qMin( readSize, missing );
+    }
+
+    QByteArray chunk( device.read( qMax( readSize, (qint64)1 ) ) );
+
+    if( chunk.isEmpty() )
+    {
+      if( device.atEnd() && ! device.isSequential() )
+      {
+        break;
+      }
+      if( ! device.waitForReadyRead( DEVICE_READ_TIMEOUT ) )
+      {
+        break;
+      }
+      continue;
+    }
+
+    if( decodeFromBase64 )
+    {
+      QByteArray decoded;
+      decoded.resize( Base64Decoder::maximumDecodedSize( chunk.size() ) );
+      decoded.resize( base64.decode( chunk.constData(), chunk.size(), decoded.data() ) );
+      chunk = decoded;
+    }
+
+    decoder.feed( chunk );
+  }
+
+  // The padding which ends the Base64 text is still part of the stream
+  if( decodeFromBase64 && decoder.isFinished() )
+  {
+    while( device.peek( 1 ) == "=" )
+    {
+      device.read( 1 );
+    }
+  }
+
+  Drawing drawing( decoder.drawing() );
+
+  // The device ended before the stream did
+  if( ! decoder.isFinished() )
+  {
+#ifdef ISFQT_DEBUG
+    qDebug() << "The device ended before the stream did";
+#endif
+    drawing.d_->error = ISF_ERROR_BAD_STREAMSIZE;
+    drawing.d_->isNull = true;
+  }
+
+  return drawing;
+}
+
+
+
+/**
+ * Create an incremental decoder.
+ *
+ * @param parent Parent object
+ */
+IncrementalDecoder::IncrementalDecoder( QObject* parent )
+: QObject( parent )
+, drawing_( new Drawing() )
+, state_( ISF_PARSER_START )
+, streamEnd_( 0 )
+, streamData_( new StreamData() )
+{
+  streamData_->dataSource = new DataSource();
+
+  // Allow the signals to be connected across threads
+  qRegisterMetaType<Isf::IsfError>( "Isf::IsfError" );
+}
+
+
+
+/**
+ * Destructor
+ */
+IncrementalDecoder::~IncrementalDecoder()
+{
+  delete streamData_->dataSource;
   delete streamData_;
-  streamData_ = 0;
-  return *drawing;
+  delete drawing_;
+}
+
+
+
+/**
+ * Return how many bytes are still missing to complete the stream.
+ *
+ * The size of the stream is only known once its header has been fed.
+ *
+ * @return Number of bytes, or -1 if the stream size is not known yet
+ */
+qint64 IncrementalDecoder::bytesMissing() const
+{
+  switch( state_ )
+  {
+    case ISF_PARSER_START:
+    case ISF_PARSER_STREAMSIZE:
+      return -1;
+
+    case ISF_PARSER_TAG:
+      return qMax( streamEnd_ - streamData_->dataSource->data().size(), (qint64)0 );
+
+    default:
+      return 0;
+  }
+}
+
+
+
+/**
+ * Return the drawing read so far.
+ *
+ * The indices announced with strokeDecoded() are those of the strokes
+ * of this drawing.
+ *
+ * @return The drawing being read
+ */
+const Drawing& IncrementalDecoder::drawing() const
+{
+  return *drawing_;
+}
+
+
+
+/**
+ * Return the error found while reading the stream, if any.
+ *
+ * @return IsfError
+ */
+IsfError IncrementalDecoder::error() const
+{
+  return drawing_->d_->error;
+}
+
+
+
+/**
+ * Read more bytes of the stream.
+ *
+ * Every tag which becomes complete with these bytes is read right away;
+ * the bytes of an incomplete tag are kept until the rest arrives.
+ *
+ * @param data Next bytes of the ISF stream
+ */
+void IncrementalDecoder::feed( const QByteArray& data )
+{
+  if( state_ == ISF_PARSER_FINISH )
+  {
+#ifdef ISFQT_DEBUG
+    qDebug() << "The stream is already over, ignoring" << data.size() << "bytes";
+#endif
+    return;
+  }
+
+  DataSource* dataSource = streamData_->dataSource;
+  dataSource->append( data );
+
+  const QByteArray& buffer = dataSource->data();
+
+  while( state_ != ISF_PARSER_FINISH )
+  {
+    qint64  pos = dataSource->pos();
+    quint64 value;
+
+    switch( state_ )
+    {
+      case ISF_PARSER_START:
+      {
+        if( ! peekUInt( buffer, pos, value ) )
+        {
+          break;
+        }
+
+        dataSource->seekRelative( (int)( pos - dataSource->pos() ) );
+
+#ifdef ISFQT_DEBUG_VERBOSE
+        qDebug() << "Version:" << value;
+#endif
+        if( value != SUPPORTED_ISF_VERSION )
+        {
+          drawing_->d_->isNull = true;
+          finish( ISF_ERROR_BAD_VERSION );
+          return;
+        }
+
+        state_ = ISF_PARSER_STREAMSIZE;
+        continue;
+      }
+
+      case ISF_PARSER_STREAMSIZE:
+      {
+        if( ! peekUInt( buffer, pos, value ) )
+        {
+          break;
+        }
+
+        dataSource->seekRelative( (int)( pos - dataSource->pos() ) );
+
+        if( value == 0 || value > (quint64)std::numeric_limits<int>::max() )
+        {
+#ifdef ISFQT_DEBUG
+          qDebug() << "Invalid stream size" << value;
+#endif
+          finish( ISF_ERROR_BAD_STREAMSIZE );
+          return;
+        }
+
+#ifdef ISFQT_DEBUG
+        qDebug() << "Reading ISF stream of size:" << value << "...";
+#endif
+        streamEnd_ = pos + value;
+        drawing_->d_->isNull = false;
+
+        state_ = ISF_PARSER_TAG;
+        continue;
+      }
+
+      case ISF_PARSER_TAG:
+      {
+        if( pos >= streamEnd_ )
+        {
+          finish( ISF_ERROR_NONE );
+          return;
+        }
+
+        // Only read the next tag when all of its bytes are here
+        quint64 length;
+        if( ! TagsParser::tagLength( buffer, pos, drawing_, length ) )
+        {
+          break;
+        }
+
+        if( length > (quint64)( streamEnd_ - pos ) )
+        {
+#ifdef ISFQT_DEBUG
+          qDebug() << "A tag of" << length << "bytes goes past the end of the stream";
+#endif
+          finish( ISF_ERROR_INVALID_STREAM );
+          return;
+        }
+
+        if( length > (quint64)( buffer.size() - pos ) )
+        {
+          break;
+        }
+
+        IsfError error = TagsParser::nextTag( streamData_, drawing_ );
+
+        // Decompress the stroke right away, rather than at the end of the stream
+        if( error == ISF_ERROR_NONE && ! streamData_->pendingStrokes.isEmpty() )
+        {
+          error = TagsParser::inflateStrokes( streamData_, drawing_ );
+          if( error == ISF_ERROR_NONE )
+          {
+            emit strokeDecoded( drawing_->d_->strokes.count() - 1 );
+          }
+        }
+
+        if( error != ISF_ERROR_NONE )
+        {
+#ifdef ISFQT_DEBUG_VERBOSE
+          qWarning() << "Error in last operation, stopping.";
+#endif
+          finish( error );
+          return;
+        }
+
+        continue;
+      }
+
+      default:
+        break;
+    }
+
+    // Wait for more data
+    break;
+  }
+
+  // Don't hold on to the bytes which have been read already
+  const qint64 pos = dataSource->pos();
+  if( pos > 0 )
+  {
+    dataSource->setData( buffer.mid( pos ) );
+    if( state_ == ISF_PARSER_TAG )
+    {
+      streamEnd_ -= pos;
+    }
+  }
+}
+
+
+
+/**
+ * Stop reading the stream.
+ *
+ * @param error Reason why the stream is over
+ */
+void IncrementalDecoder::finish( IsfError error )
+{
+  state_ = ISF_PARSER_FINISH;
+  drawing_->d_->error = error;
+
+#ifdef ISFQT_DEBUG
+  qDebug() << "Finished with" << ( error == ISF_ERROR_NONE ? "success" : "error" );
+#endif
+
+  // Don't hold on to the stream bytes and the parser data
+  streamData_->dataSource->clear();
+  streamData_->reset();
+
+  emit finished( error );
+}
+
+
+
+/**
+ * Return whether the stream is over.
+ *
+ * @return bool
+ */
+bool IncrementalDecoder::isFinished() const
+{
+  return ( state_ == ISF_PARSER_FINISH );
+}
+
+
+
+/**
+ * Forget the current stream, to start reading a new one.
+ */
+void IncrementalDecoder::reset()
+{
+  *drawing_ = Drawing();
+  state_ = ISF_PARSER_START;
+  streamEnd_ = 0;
+
+  streamData_->dataSource->clear();
+  streamData_->reset();
+}
+
+
+
+/**
+ * Convert many raw ISF data streams into drawings, in parallel.
+ *
+ * The streams are decoded by the idle threads of the global QThreadPool,
+ * and by the calling thread.
+ *
+ * A null Drawing is returned for each invalid stream; the error() method of
+ * each drawing tells whether its stream was read successfully.
+ *
+ * @see reader()
+ * @param streams Source byte arrays, each with an ISF stream
+ * @param decodeFromBase64 Whether the bytes are in the Base64 format and
+ *                         need to be decoded first
+ * @return One Isf::Drawing per stream, in the same order as the streams
+ */
+QList<Drawing> Stream::readerBatch( const QList<QByteArray>& streams, bool decodeFromBase64 )
+{
+  QVector<Drawing> results( streams.count() );
+  Drawing*         output = results.data();
+  QAtomicInt       nextIndex( 0 );
+
+  // Each worker takes the next stream not yet taken by the others, so the work
+  // gets spread evenly even when the streams have very different sizes
+  runInParallel( [&]()
+  {
+    // The same decoder is reused for all the streams decoded by a worker
+    Decoder decoder;
+
+    int index;
+    while( ( index = nextIndex.fetchAndAddRelaxed( 1 ) ) < streams.count() )
+    {
+      output[ index ] = decoder.decode( streams.at( index ), decodeFromBase64 );
+    }
+  }, streams.count() );
+
+  return results.toList();
 }
 
 
@@ -209,14 +778,14 @@ Drawing& Stream::reader( const QByteArray& rawData, bool decodeFromBase64 )
  *                         need to be decoded first
  * @return an Isf::Drawing, with null contents on error
  */
-Drawing& Stream::readerGif( const QByteArray& gifRawBytes, bool decodeFromBase64 )
+Drawing Stream::readerGif( const QByteArray& gifRawBytes, bool decodeFromBase64 )
 {
   QByteArray isfData;
 
 #if ISFQT_GIF_ENABLED == 1
 
   QByteArray gifBytes( decodeFromBase64
-                        ? QByteArray::fromBase64( gifRawBytes )
+                        ? Base64Decoder::decode( gifRawBytes )
                         : gifRawBytes );
 
 /**
@@ -314,7 +883,7 @@ Drawing& Stream::readerGif( const QByteArray& gifRawBytes, bool decodeFromBase64
  *                         need to be decoded first
  * @return an Isf::Drawing, with null contents on error
  */
-Drawing& Stream::readerPng( const QByteArray& pngRawBytes, bool decodeFromBase64 )
+Drawing Stream::readerPng( const QByteArray& pngRawBytes, bool decodeFromBase64 )
 {
   QByteArray isfData;
 
@@ -323,7 +892,7 @@ Drawing& Stream::readerPng( const QByteArray& pngRawBytes, bool decodeFromBase64
 #endif
 
   QByteArray pngBytes( decodeFromBase64
-                        ? QByteArray::fromBase64( pngRawBytes )
+                        ? Base64Decoder::decode( pngRawBytes )
                         : pngRawBytes );
 
   QImage imageData( QImage::fromData( pngBytes, "PNG" ) );
@@ -339,11 +908,10 @@ Drawing& Stream::readerPng( const QByteArray& pngRawBytes, bool decodeFromBase64
 #ifdef ISFQT_DEBUG_VERBOSE
       qDebug() << "ISF data found! Decoding from Base64 and parsing it...";
 #endif
-      isfData = QByteArray::fromBase64( isfData );
     }
   }
 
-  return reader( isfData );
+  return reader( isfData, true );
 }
 
 
@@ -360,28 +928,185 @@ bool Stream::supportsGif()
 
 
 
+/**
+ * Create an encoder.
+ */
+Encoder::Encoder()
+: streamData_( new StreamData() )
+{
+  streamData_->dataSource = new DataSource();
+}
+
+
+
+/**
+ * Destructor
+ */
+Encoder::~Encoder()
+{
+  delete streamData_->dataSource;
+  delete streamData_;
+}
+
+
+
 /**
  * Convert a drawing into a raw ISF data stream.
  *
  * The resulting byte array will be empty if the drawing is not valid.
  *
+ * When encoding to Base64, the stream is encoded as it is written: only
+ * the encoded copy is ever made.
+ *
  * @param drawing Source drawing
  * @param encodeToBase64 Whether the converted ISF stream should be
  *                       encoded with Base64 or not
+ * @param level How hard to try to make the stream smaller
  * @return Byte array with an ISF data stream
  */
-QByteArray Stream::writer( const Drawing& drawing, bool encodeToBase64 )
+QByteArray Encoder::encode( const Drawing& drawing, bool encodeToBase64, CompressionLevel level )
+{
+  const qint64 streamSize = prepare( drawing, level );
+  if( streamSize < 0 )
+  {
+    return QByteArray();
+  }
+
+  DataSource* dataSource = streamData_->dataSource;
+
+  // Encode each piece of the stream as it comes, straight into a buffer
+  // which is big enough for the whole encoded stream. The raw stream is
+  // never put together
+  if( encodeToBase64 )
+  {
+    QVector<QByteArray>& strokesData = streamData_->strokesData;
+
+    QByteArray encoded;
+    encoded.resize( Base64Encoder::maximumEncodedSize( streamSize ) );
+
+    Base64Encoder base64;
+    char* output = encoded.data();
+
+    output += base64.encode( dataSource->data().constData(), dataSource->data().size(), output );
+    dataSource->clear();
+
+    for( int index = 0; index < strokesData.count(); ++index )
+    {
+      output += base64.encode( strokesData.at( index ).constData(), strokesData.at( index ).size(), output );
+      strokesData[ index ].clear();
+    }
+
+    output += base64.finish( output );
+    Q_ASSERT( output == encoded.constData() + encoded.size() );
+
+    // Don't hold on to the writer data
+    streamData_->reset();
+
+    return encoded;
+  }
+
+  // Write the strokes after the other tags, in a buffer which is big enough
+  // for the whole stream
+  dataSource->reserve( streamSize );
+  TagsWriter::addStrokes( streamData_, &drawing );
+
+  QByteArray data( dataSource->data() );
+
+  // Don't hold on to the stream bytes and the writer data
+  dataSource->clear();
+  streamData_->reset();
+
+  return data;
+}
+
+
+
+/**
+ * Write a drawing to a device as a raw ISF data stream.
+ *
+ * All the strokes are compressed in memory first, since the stream header
+ * needs the size of the whole stream. Then the tags and each stroke are
+ * written in turn, and released as soon as they have been written: this
+ * avoids building one more copy of the stream, and of its Base64 text.
+ *
+ * @param drawing Source drawing
+ * @param device Device where to write the stream, already open
+ * @param encodeToBase64 Whether the converted ISF stream should be
+ *                       encoded with Base64 or not
+ * @param level How hard to try to make the stream smaller
+ * @return bool False if the drawing is not valid or the device could not
+ *              be written
+ */
+bool Encoder::encode( const Drawing& drawing, QIODevice& device, bool encodeToBase64, CompressionLevel level )
+{
+  if( prepare( drawing, level ) < 0 )
+  {
+    return false;
+  }
+
+  DataSource*          dataSource = streamData_->dataSource;
+  QVector<QByteArray>& strokesData = streamData_->strokesData;
+
+  // Keeps the bytes still to be converted to Base64
+  Base64Encoder  encoder;
+  Base64Encoder* base64 = encodeToBase64 ? &encoder : 0;
+
+  // Write the header and the tags, then the strokes
+  bool success = writeToDevice( device, dataSource->data(), base64 );
+  dataSource->clear();
+
+  for( int index = 0; success && index < strokesData.count(); ++index )
+  {
+    success = writeToDevice( device, strokesData.at( index ), base64 );
+    strokesData[ index ].clear();
+  }
+
+  if( success && base64 != 0 )
+  {
+    char padding[ 4 ];
+    const int size = base64->finish( padding );
+    success = ( device.write( padding, size ) == size );
+  }
+
+  // Don't hold on to the writer data
+  streamData_->reset();
+
+#ifdef ISFQT_DEBUG
+  if( ! success )
+  {
+    qWarning() << "Could not write the stream to the device:" << device.errorString();
+  }
+#endif
+
+  return success;
+}
+
+
+
+/**
+ * Prepare the stream of a drawing.
+ *
+ * All the tags are written to the data source, preceded by the stream
+ * header, except the strokes: these are only compressed and kept in the
+ * stream data, ready to be written by TagsWriter::addStrokes().
+ *
+ * @param drawing Source drawing
+ * @param level How hard to try to make the stream smaller
+ * @return Size of the whole stream, or -1 if the drawing is not valid
+ */
+qint64 Encoder::prepare( const Drawing& drawing, CompressionLevel level )
 {
   if( drawing.isNull() || drawing.error() != ISF_ERROR_NONE )
   {
 #ifdef ISFQT_DEBUG
     qDebug() << "The drawing was not valid!";
 #endif
-    return QByteArray();
+    return -1;
   }
 
-  streamData_ = new StreamData();
-  streamData_->dataSource = new DataSource();
+  streamData_->reset();
+  streamData_->compressionLevel = level;
+  streamData_->dataSource->clear();
   DataSource* dataSource = streamData_->dataSource;
 
   // Add the initial data
@@ -402,29 +1127,98 @@ QByteArray Stream::writer( const Drawing& drawing, bool encodeToBase64 )
   // Write the transforms
   TagsWriter::addTransformationTable( streamData_, &drawing );
 
-  // Write the strokes
-  TagsWriter::addStrokes( streamData_, &drawing );
+  // Compress the strokes
+  TagsWriter::prepareStrokes( streamData_, &drawing );
+
+  // The stream starts with the version number and the size of the tags.
+  // Now that all sizes are known, write the header before the tags. The
+  // tags written so far are small, the bulk of the stream is made by the
+  // strokes
+  const QByteArray tags( dataSource->data() );
 
-  // Write the stream size (at the start of the stream)
-  encodeUInt( dataSource, dataSource->size(), true/*prepend*/ );
+  quint64 tagsSize = tags.size();
+  foreach( const QByteArray& strokeData, streamData_->strokesData )
+  {
+    tagsSize += strokeData.size();
+  }
 
-  // Write the version number (at the start of the stream)
-  encodeUInt( dataSource, SUPPORTED_ISF_VERSION, true/*prepend*/ );
+  const QByteArray version( encodeUInt( SUPPORTED_ISF_VERSION ) );
+  const QByteArray size   ( encodeUInt( tagsSize ) );
 
-  QByteArray data( dataSource->data() );
+  dataSource->clear();
+  dataSource->append( version );
+  dataSource->append( size );
+  dataSource->append( tags );
 
-  delete streamData_->dataSource;
-  delete streamData_;
-  streamData_ = nullptr;
+  return version.size() + size.size() + tagsSize;
+}
 
-  // Convert to Base64 if needed
-  if( encodeToBase64 )
+
+
+/**
+ * Write a piece of stream to a device.
+ *
+ * When encoding to Base64, the bytes which do not make a whole group of 3
+ * are kept by the encoder, for the next piece.
+ *
+ * @param device Device where to write the data
+ * @param data Bytes to write
+ * @param base64 Encoder to convert the data to Base64 with, or 0 to write
+ *               the data as it is
+ * @return bool False if the device could not be written
+ */
+bool Encoder::writeToDevice( QIODevice& device, const QByteArray& data, Base64Encoder* base64 )
+{
+  if( base64 == 0 )
   {
-    return data.toBase64();
+    return ( device.write( data ) == data.size() );
   }
 
-    return data;
+  QByteArray encoded;
+  encoded.resize( Base64Encoder::maximumEncodedSize( data.size() ) );
+  encoded.resize( base64->encode( data.constData(), data.size(), encoded.data() ) );
+
+  return ( device.write( encoded ) == encoded.size() );
+}
+
 
+
+/**
+ * Convert a drawing into a raw ISF data stream.
+ *
+ * The resulting byte array will be empty if the drawing is not valid.
+ *
+ * @see Encoder
+ * @param drawing Source drawing
+ * @param encodeToBase64 Whether the converted ISF stream should be
+ *                       encoded with Base64 or not
+ * @param level How hard to try to make the stream smaller
+ * @return Byte array with an ISF data stream
+ */
+QByteArray Stream::writer( const Drawing& drawing, bool encodeToBase64, CompressionLevel level )
+{
+  Encoder encoder;
+  return encoder.encode( drawing, encodeToBase64, level );
+}
+
+
+
+/**
+ * Write a drawing to a device as a raw ISF data stream.
+ *
+ * @see Encoder
+ * @param drawing Source drawing
+ * @param device Device where to write the stream, already open
+ * @param encodeToBase64 Whether the converted ISF stream should be
+ *                       encoded with Base64 or not
+ * @param level How hard to try to make the stream smaller
+ * @return bool False if the drawing is not valid or the device could not
+ *              be written
+ */
+bool Stream::writer( const Drawing& drawing, QIODevice& device, bool encodeToBase64, CompressionLevel level )
+{
+  Encoder encoder;
+  return encoder.encode( drawing, device, encodeToBase64, level );
 }
 
 
@@ -445,9 +1239,10 @@ QByteArray Stream::writer( const Drawing& drawing, bool encodeToBase64 )
  * @param drawing Source drawing
  * @param encodeToBase64 Whether the converted GIF should be
  *                       encoded with Base64 or not
+ * @param level How hard to try to make the embedded ISF stream smaller
  * @return Byte array with a GIF data stream (optionally encoded with Base64)
  */
-QByteArray Stream::writerGif( const Drawing& drawing, bool encodeToBase64 )
+QByteArray Stream::writerGif( const Drawing& drawing, bool encodeToBase64, CompressionLevel level )
 {
   QByteArray imageBytes;
 
@@ -455,7 +1250,7 @@ QByteArray Stream::writerGif( const Drawing& drawing, bool encodeToBase64 )
   Drawing source( drawing );
 
   // Get the ISF data stream
-  QByteArray isfData( writer( source ) );
+  QByteArray isfData( writer( source, false, level ) );
 
 #ifdef ISFQT_DEBUG_VERBOSE
   qDebug() << "GIF-Fortifying an ISF stream of size" << isfData.size();
@@ -652,14 +1447,15 @@ QByteArray Stream::writerGif( const Drawing& drawing, bool encodeToBase64 )
  * @param drawing Source drawing
  * @param encodeToBase64 Whether the converted ISF stream should be
  *                       encoded with Base64 or not
+ * @param level How hard to try to make the embedded ISF stream smaller
  * @return Byte array with a PNG data stream (optionally encoded with Base64)
  */
-QByteArray Stream::writerPng( const Drawing& drawing, bool encodeToBase64 )
+QByteArray Stream::writerPng( const Drawing& drawing, bool encodeToBase64, CompressionLevel level )
 {
   Drawing source( drawing );
 
   // Get the ISF data stream
-  QByteArray isfData( writer( source ) );
+  QByteArray isfData( writer( source, false, level ) );
 
 #ifdef ISFQT_DEBUG_VERBOSE
   qDebug() << "PNG-Fortifying an ISF stream of size" << isfData.size();
@@ -29,8 +29,10 @@
 
 #include <IsfQtDrawing>
 
+#include <QMutexLocker>
 #include <QPainter>
 #include <QPixmap>
+#include <QSharedData>
 #include <QPainterPath>
 
 #include <cmath>
@@ -41,22 +43,184 @@ using namespace Compress;
 
 
 
+/**
+ * Construct the data of an empty (null) drawing.
+ */
+DrawingData::DrawingData()
+: dirty( false )
+, error( ISF_ERROR_NONE )
+, hasXData( true )
+, hasYData( true )
+, isNull( true )
+, maxGuid( 0 )
+{
+}
+
+
+
+/**
+ * Copy the data of a drawing, before changing it.
+ *
+ * The strokes are cloned; their metrics and transforms are shared with the
+ * originals, which keep them alive.
+ *
+ * @param other The data to duplicate
+ */
+DrawingData::DrawingData( const DrawingData& other )
+: QSharedData( other )
+, canvas( other.canvas )
+, error( other.error )
+, guids( other.guids )
+, hasXData( other.hasXData )
+, hasYData( other.hasYData )
+, isNull( other.isNull )
+, maxGuid( other.maxGuid )
+, maxPenSize( other.maxPenSize )
+{
+  QMutexLocker cacheLocker( &other.cacheMutex );
+  QMutexLocker locker( &other.inflateMutex );
+
+  // The cache and the bounding rect may be updated by copies in the meantime
+  boundingRect = other.boundingRect;
+  cacheRect    = other.cacheRect;
+  cachePixmap  = other.cachePixmap;
+  dirty        = other.dirty;
+
+  foreach( Stroke* stroke, other.strokes )
+  {
+    // Strokes share their own data, so this doesn't copy the points
+    Stroke* newStroke = new Stroke( *stroke );
+
+    // Strokes which are still compressed stay so within the copy
+    if( other.pendingStrokes.contains( stroke ) )
+    {
+      PendingStroke pending( other.pendingStrokes.value( stroke ) );
+      pending.stroke = newStroke;
+      pendingStrokes.insert( newStroke, pending );
+    }
+
+    strokes.append( newStroke );
+  }
+
+  // The strokes still to be painted are the same, within the copy
+  foreach( Stroke* stroke, other.changedStrokes )
+  {
+    changedStrokes.append( strokes.at( other.strokes.indexOf( stroke ) ) );
+  }
+}
+
+
+
+/**
+ * Delete the strokes.
+ */
+DrawingData::~DrawingData()
+{
+  qDeleteAll( strokes );
+}
+
+
+
+/**
+ * Delete a stroke object.
+ *
+ * @param stroke The stroke to delete
+ */
+void DrawingData::destroyStroke( Stroke* stroke )
+{
+  pendingStrokes.remove( stroke );
+
+  delete stroke;
+}
+
+
+
+/**
+ * Decompress the points of strokes which were loaded lazily.
+ *
+ * @param stroke The stroke which is needed, or 0 to decompress all of them
+ */
+void DrawingData::inflate( Stroke* stroke ) const
+{
+  QMutexLocker locker( &inflateMutex );
+
+  if( pendingStrokes.isEmpty() )
+  {
+    return;
+  }
+
+  QList<PendingStroke> strokesToInflate;
+  if( stroke == 0 )
+  {
+    strokesToInflate = pendingStrokes.values();
+    pendingStrokes.clear();
+  }
+  else if( pendingStrokes.contains( stroke ) )
+  {
+    strokesToInflate.append( pendingStrokes.take( stroke ) );
+  }
+
+  IsfError strokesError = TagsParser::inflateStrokes( strokesToInflate );
+  if( error == ISF_ERROR_NONE )
+  {
+    error = strokesError;
+  }
+
+  // The bounding rect is only read once all the strokes are decompressed
+  if( pendingStrokes.isEmpty() )
+  {
+    boundingRect = strokesBoundingRect( strokes );
+  }
+}
+
+
+
+/**
+ * Compute the rectangle which contains some strokes of the drawing.
+ *
+ * The rectangle is grown by the thickest pen, plus one pixel.
+ *
+ * @param strokeList The strokes to contain
+ * @return Bounding rectangle of the strokes
+ */
+QRect DrawingData::strokesBoundingRect( const QList<Stroke*>& strokeList ) const
+{
+  QRect  rect;
+  QSizeF thickestPen( maxPenSize );
+
+  foreach( Stroke* stroke, strokeList )
+  {
+    QMatrix* transform = stroke->transform();
+    if( transform != 0 )
+    {
+      rect = rect.united( transform->mapRect( stroke->boundingRect() ) );
+    }
+    else
+    {
+      rect = rect.united( stroke->boundingRect() );
+    }
+
+    thickestPen = thickestPen.width() < stroke->penSize().width() ? stroke->penSize() : thickestPen;
+  }
+
+  const QSize penSize( thickestPen.toSize() );
+  return rect.adjusted( -penSize.width() - 1, -penSize.height() - 1,
+                        +penSize.width() + 1, +penSize.height() + 1 );
+}
+
+
+
 /**
  * Construct a new empty (null) Drawing instance.
  *
  * As soon as you add data, the instance becomes non-nullptr.
  */
 Drawing::Drawing()
-: error_( ISF_ERROR_NONE )
-, hasXData_( true )
-, hasYData_( true )
-, isNull_( true )
-, maxGuid_( 0 )
+: d_( new DrawingData() )
 {
 #ifdef ISFQT_DEBUG_VERBOSE
   qDebug() << "** Created new ISF drawing:" << this << "**";
 #endif
-  clear();
 }
 
 
@@ -64,39 +228,39 @@ Drawing::Drawing()
 /**
  * Construct a copy of an existing Drawing instance.
  *
+ * The drawing data is shared until either copy gets changed.
+ *
  * @param other The instance to duplicate.
  */
 Drawing::Drawing( const Drawing& other )
-: boundingRect_( other.boundingRect_ )
-, canvas_( other.canvas_ )
-, error_( other.error_ )
-, guids_( other.guids_ )
-, hasXData_( other.hasXData_ )
-, hasYData_( other.hasYData_ )
-, isNull_( other.isNull_ )
-, maxGuid_( other.maxGuid_ )
-, maxPenSize_( other.maxPenSize_ )
+: d_( other.d_ )
 {
 #ifdef ISFQT_DEBUG_VERBOSE
   qDebug() << "** Copying ISF drawing:" << (void*)&other << "into new:" << this << "**";
 #endif
+}
 
-  // Clone the stroke objects
-  foreach( Stroke* stroke, other.strokes_ )
-  {
-    Stroke* newStroke = new Stroke( *stroke );
-    strokes_.append( newStroke );
-  }
+
+/**
+ * Move an existing Drawing instance into a new one.
+ *
+ * The other instance is left as an empty (null) drawing.
+ *
+ * @param other The instance to move.
+ */
+Drawing::Drawing( Drawing&& other )
+: d_( new DrawingData() )
+{
+  d_.swap( other.d_ );
 }
 
 
+
 /**
  * Destructor
  */
 Drawing::~Drawing()
 {
-  qDeleteAll( strokes_ );
-
 #ifdef ISFQT_DEBUG_VERBOSE
   qDebug() << "** Destroyed ISF drawing:" << this << "**";
 #endif
@@ -104,6 +268,38 @@ Drawing::~Drawing()
 
 
 
+/**
+ * Replace the contents of this drawing with a copy of another drawing.
+ *
+ * The drawing data is shared until either copy gets changed.
+ *
+ * @param other The instance to duplicate.
+ * @return This drawing
+ */
+Drawing& Drawing::operator =( const Drawing& other )
+{
+  d_ = other.d_;
+  return *this;
+}
+
+
+
+/**
+ * Replace the contents of this drawing with the contents of another drawing.
+ *
+ * The two drawings swap their data, so no stroke gets copied.
+ *
+ * @param other The instance to move.
+ * @return This drawing
+ */
+Drawing& Drawing::operator =( Drawing&& other )
+{
+  d_.swap( other.d_ );
+  return *this;
+}
+
+
+
 /**
  * Add a new stroke to the drawing.
  *
@@ -135,18 +331,18 @@ qint32 Drawing::addStroke( Stroke* newStroke )
     return -1;
   }
 
-  isNull_ = false;
-  strokes_.append( newStroke );
-  maxPenSize_ = maxPenSize_.width() < newStroke->penSize().width() ? newStroke->penSize() : maxPenSize_;
+  d_->isNull = false;
+  d_->strokes.append( newStroke );
+  d_->maxPenSize = d_->maxPenSize.width() < newStroke->penSize().width() ? newStroke->penSize() : d_->maxPenSize;
 
   // This stroke needs to be painted
-  changedStrokes_.append( newStroke );
+  d_->changedStrokes.append( newStroke );
 
-  dirty_ = true;
+  d_->dirty = true;
 
   updateBoundingRect();
 
-  return ( strokes_.count() - 1 );
+  return ( d_->strokes.count() - 1 );
 }
 
 
@@ -162,7 +358,9 @@ qint32 Drawing::addStroke( Stroke* newStroke )
  */
 QRect Drawing::boundingRect() const
 {
-  return boundingRect_;
+  d_->inflate();
+
+  return d_->boundingRect;
 }
 
 
@@ -174,23 +372,8 @@ QRect Drawing::boundingRect() const
  */
 void Drawing::clear()
 {
-  // Clean up the internal property lists
-  qDeleteAll( strokes_ );
-  strokes_       .clear();
-  changedStrokes_.clear();
-
-  // Nullify the other properties
-  boundingRect_ = QRect();
-  canvas_       = QRect();
-  cacheRect_    = QRect();
-  error_        = ISF_ERROR_NONE;
-  hasXData_     = true;
-  hasYData_     = true;
-  isNull_       = true;
-  maxGuid_      = 0;
-  maxPenSize_   = QSizeF();
-  dirty_        = false;
-  cachePixmap_  = QPixmap();
+  // Leave any other copy of the drawing alone
+  d_ = new DrawingData();
 }
 
 
@@ -203,19 +386,19 @@ void Drawing::clear()
  */
 bool Drawing::deleteStroke( quint32 index )
 {
-  if( (qint64)index >= strokes_.count() )
+  if( (qint64)index >= d_->strokes.count() )
   {
     return false;
   }
 
-  Stroke* victim = strokes_.takeAt( index );
+  Stroke* victim = d_->strokes.takeAt( index );
 
-  // make sure this goes from the changedStrokes_ list too.
-  changedStrokes_.removeAll( victim );
+  // make sure this goes from the changedStrokes list too.
+  d_->changedStrokes.removeAll( victim );
 
-  delete victim;
+  d_->destroyStroke( victim );
 
-  dirty_ = true;
+  d_->dirty = true;
 
   updateBoundingRect();
 
@@ -232,12 +415,15 @@ bool Drawing::deleteStroke( quint32 index )
  */
 bool Drawing::deleteStroke( Stroke* stroke )
 {
-  if ( ! strokes_.contains( stroke ) )
+  // Look the stroke up before the data gets detached from other copies
+  qint32 index = indexOfStroke( stroke );
+
+  if ( index < 0 )
   {
     return false;
   }
 
-  return deleteStroke( strokes_.indexOf( stroke ) );
+  return deleteStroke( index );
 }
 
 
@@ -247,11 +433,14 @@ bool Drawing::deleteStroke( Stroke* stroke )
  *
  * If nothing went wrong, this returns ISF_ERROR_NONE.
  *
+ * Strokes of lazily loaded drawings which cannot be decompressed are only
+ * reported once they are needed.
+ *
  * @return The last ISF error status
  */
 IsfError Drawing::error() const
 {
-  return error_;
+  return d_->error;
 }
 
 
@@ -264,7 +453,7 @@ IsfError Drawing::error() const
  */
 qint32 Drawing::indexOfStroke( const Stroke* stroke ) const
 {
-  return strokes_.indexOf( const_cast<Stroke*>( stroke ) );
+  return d_->strokes.indexOf( const_cast<Stroke*>( stroke ) );
 }
 
 
@@ -278,7 +467,7 @@ qint32 Drawing::indexOfStroke( const Stroke* stroke ) const
  */
 bool Drawing::isEmpty() const
 {
-  return strokes_.empty();
+  return d_->strokes.empty();
 }
 
 
@@ -294,7 +483,7 @@ bool Drawing::isEmpty() const
  */
 bool Drawing::isNull() const
 {
-  return isNull_;
+  return d_->isNull;
 }
 
 
@@ -313,16 +502,20 @@ bool Drawing::isNull() const
  *                        Default is transparent.
  * @return The rendered drawing, or a null one on error.
  */
-QPixmap Drawing::pixmap( const QColor backgroundColor )
+QPixmap Drawing::pixmap( const QColor backgroundColor ) const
 {
   if( isNull() )
   {
     return QPixmap();
   }
 
-  if( ! dirty_ && ! cachePixmap_.isNull() )
+  QMutexLocker locker( &d_->cacheMutex );
+
+  d_->inflate();
+
+  if( ! d_->dirty && ! d_->cachePixmap.isNull() )
   {
-    return cachePixmap_;
+    return d_->cachePixmap;
   }
 
   QSize drawingSize( size() );
@@ -336,63 +529,63 @@ QPixmap Drawing::pixmap( const QColor backgroundColor )
   }
 
   // is the cache null, or are we repainting everything? if so, create a new pixmap.
-  if( cachePixmap_.isNull() || changedStrokes_.isEmpty() )
+  if( d_->cachePixmap.isNull() || d_->changedStrokes.isEmpty() )
   {
-    cachePixmap_ = QPixmap( drawingSize );
-    cachePixmap_.fill( backgroundColor );
-    cacheRect_ = boundingRect_;
+    d_->cachePixmap = QPixmap( drawingSize );
+    d_->cachePixmap.fill( backgroundColor );
+    d_->cacheRect = d_->boundingRect;
   }
   else
   {
     // otherwise, resize and repaint the cache.
 
-    QRect newRect = boundingRect_;
+    QRect newRect = d_->boundingRect;
 
-    // has the size of the drawing changed? if so, resize the cachePixmap_.
-    if( cacheRect_.size() != newRect.size() )
+    // has the size of the drawing changed? if so, resize the cache pixmap.
+    if( d_->cacheRect.size() != newRect.size() )
     {
 //       qDebug() << "Cache pixmap needs resizing to" << drawingSize;
-//       qDebug() << "Cache rect:" << cacheRect_;
+//       qDebug() << "Cache rect:" << d_->cacheRect;
 //       qDebug() << "New rect:" << newRect;
 
       QPixmap pixmap( drawingSize );
       pixmap.fill( backgroundColor );
       QPainter painter( &pixmap );
 
-      int xOffset = ( newRect.x() - cacheRect_.x() ) * -1;
-      int yOffset = ( newRect.y() - cacheRect_.y() ) * -1;
+      int xOffset = ( newRect.x() - d_->cacheRect.x() ) * -1;
+      int yOffset = ( newRect.y() - d_->cacheRect.y() ) * -1;
 
 //       qDebug() << "x-offset:"<<xOffset<<", y-offset:"<<yOffset;
-      painter.drawPixmap( xOffset, yOffset, cachePixmap_ );
+      painter.drawPixmap( xOffset, yOffset, d_->cachePixmap );
 
-      cachePixmap_ = pixmap;
-      cacheRect_ = newRect;
+      d_->cachePixmap = pixmap;
+      d_->cacheRect = newRect;
     }
   }
 
   // if we're told specifically what strokes to paint, only paint those ones.
   // otherwise, paint all of them.
 
-  QList<Stroke*> strokes = ( changedStrokes_.isEmpty() ? strokes_ : changedStrokes_ );
+  QList<Stroke*> strokes = ( d_->changedStrokes.isEmpty() ? d_->strokes : d_->changedStrokes );
 
 #ifdef ISFQT_DEBUG
   qDebug() << "Rendering a drawing of size" << drawingSize;
 #endif
 
 #ifdef ISFQT_DEBUG_VERBOSE
-  qDebug() << "Rendering" << strokes.count() << "out of" << strokes_.count() << "strokes in the drawing.";
+  qDebug() << "Rendering" << strokes.count() << "out of" << d_->strokes.count() << "strokes in the drawing.";
 #endif
 
   // if there are no strokes there's no point going
   // through the rest of this logic.
   if ( strokes.count() == 0 )
   {
-    return cachePixmap_;
+    return d_->cachePixmap;
   }
 
-  QPainter painter( &cachePixmap_ );
+  QPainter painter( &d_->cachePixmap );
 
-  painter.setWindow( boundingRect_ );
+  painter.setWindow( d_->boundingRect );
   painter.setWorldMatrixEnabled( true );
   painter.setRenderHints(   QPainter::Antialiasing
                           | QPainter::SmoothPixmapTransform
@@ -449,31 +642,31 @@ QPixmap Drawing::pixmap( const QColor backgroundColor )
       painter.setBrush( Qt::transparent );
     }
 
-    const PointList& points = stroke->points();
+    const int numPoints = stroke->pointCount();
 
 #ifdef ISFQT_DEBUG_VERBOSE
-    qDebug() << "Rendering stroke" << index << "containing" << stroke->points().count() << "points";
+    qDebug() << "Rendering stroke" << index << "containing" << numPoints << "points";
     qDebug() << "- Stroke color:" << stroke->color().name() << "Pen size:" << pen.widthF();
 #endif
 
     ++index;
 
-    if( points.count() == 0 )
+    if( numPoints == 0 )
     {
       continue;
     }
 
     // TODO: pressure data.
-    if( points.count() > 1 )
+    if( numPoints > 1 )
     {
       painter.drawPath( stroke->painterPath() );
     }
     else
     {
-      Point point = stroke->points().first();
+      QPoint point( stroke->xPositions().first(), stroke->yPositions().first() );
 
-//       qDebug() << "Point:" << point.position;
-      painter.drawPoint( point.position );
+//       qDebug() << "Point:" << point;
+      painter.drawPoint( point );
     }
 
 /*
@@ -490,15 +683,15 @@ QPixmap Drawing::pixmap( const QColor backgroundColor )
 
   painter.end();
 
-  changedStrokes_.clear();
+  d_->changedStrokes.clear();
 
 #ifdef ISFQT_DEBUG
   qDebug() << "Rendering complete.";
 #endif
 
-  dirty_ = false;
+  d_->dirty = false;
 
-  return cachePixmap_;
+  return d_->cachePixmap;
 }
 
 
@@ -512,7 +705,9 @@ QPixmap Drawing::pixmap( const QColor backgroundColor )
  */
 void Drawing::setBoundingRect( QRect newRect )
 {
-  boundingRect_ = newRect;
+  d_->inflate();
+
+  d_->boundingRect = newRect;
 }
 
 
@@ -524,7 +719,7 @@ void Drawing::setBoundingRect( QRect newRect )
  */
 QSize Drawing::size() const
 {
-  return boundingRect_.size();
+  return boundingRect().size();
 }
 
 
@@ -537,12 +732,15 @@ QSize Drawing::size() const
  */
 Stroke* Drawing::stroke( quint32 index )
 {
-  if( (qint64)index >= strokes_.count() )
+  if( (qint64)index >= d_->strokes.count() )
   {
     return 0;
   }
 
-  return strokes_.at( index );
+  Stroke* stroke = d_->strokes.at( index );
+  d_->inflate( stroke );
+
+  return stroke;
 }
 
 
@@ -557,7 +755,9 @@ Stroke* Drawing::stroke( quint32 index )
  */
 Stroke* Drawing::strokeAtPoint( const QPoint& point )
 {
-  QListIterator<Stroke*> i( strokes_ );
+  d_->inflate();
+
+  QListIterator<Stroke*> i( d_->strokes );
   i.toBack();
   
   double radiusSquared = 5*5;
@@ -572,15 +772,13 @@ Stroke* Drawing::strokeAtPoint( const QPoint& point )
       continue;
     }
     
-    const PointList& points( s->points() );
+    const QVector<qint32>& xPositions( s->xPositions() );
+    const QVector<qint32>& yPositions( s->yPositions() );
     
-    for( int j = 0; j < points.size(); j++)
+    for( int j = 0; j < xPositions.size(); j++)
     {
-      QPoint p1 = points.at(j).position;
-      QPoint p2 = point;
-
-      double d1 = p1.x() - p2.x();
-      double d2 = p1.y() - p2.y();
+      double d1 = xPositions[ j ] - point.x();
+      double d2 = yPositions[ j ] - point.y();
       double dist = d1*d1 + d2*d2;
 
       if ( dist <= radiusSquared )
@@ -595,6 +793,20 @@ Stroke* Drawing::strokeAtPoint( const QPoint& point )
 
 
 
+/**
+ * Return the number of strokes.
+ *
+ * Unlike strokes(), this never needs to decompress lazily loaded strokes.
+ *
+ * @return Number of strokes in the drawing
+ */
+int Drawing::strokeCount() const
+{
+  return d_->strokes.count();
+}
+
+
+
 /**
  * Retrieve the strokes.
  *
@@ -602,7 +814,9 @@ Stroke* Drawing::strokeAtPoint( const QPoint& point )
  */
 const QList<Stroke*> Drawing::strokes()
 {
-  return strokes_;
+  d_->inflate();
+
+  return d_->strokes;
 }
 
 
@@ -614,32 +828,20 @@ const QList<Stroke*> Drawing::strokes()
 void Drawing::updateBoundingRect()
 {
 #ifdef ISFQT_DEBUG_VERBOSE
-  QRect oldRect( boundingRect_ );
+  QRect oldRect( d_->boundingRect );
 #endif
 
-  boundingRect_ = QRect();
-  foreach( Stroke* stroke, strokes_ )
-  {
-    const QRect rect( stroke->boundingRect() );
-    QMatrix* transform = stroke->transform();
-    if( transform != 0 )
-    {
-      boundingRect_ = boundingRect_.united( transform->mapRect( rect ) );
-    }
-    else
-    {
-      boundingRect_ = boundingRect_.united( rect );
-    }
+  d_->inflate();
 
-    maxPenSize_ = maxPenSize_.width() < stroke->penSize().width() ? stroke->penSize() : maxPenSize_;
+  foreach( Stroke* stroke, d_->strokes )
+  {
+    d_->maxPenSize = d_->maxPenSize.width() < stroke->penSize().width() ? stroke->penSize() : d_->maxPenSize;
   }
 
-  const QSize penSize( maxPenSize_.toSize() );
-  boundingRect_.adjust( -penSize.width() - 1, -penSize.height() - 1,
-                        +penSize.width() + 1, +penSize.height() + 1 );
+  d_->boundingRect = d_->strokesBoundingRect( d_->strokes );
 
 #ifdef ISFQT_DEBUG_VERBOSE
-  qDebug() << "Bounding rectangle updated: from" << oldRect << "to" << boundingRect_;
+  qDebug() << "Bounding rectangle updated: from" << oldRect << "to" << d_->boundingRect;
 #endif
 }
 
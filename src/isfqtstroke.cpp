@@ -25,20 +25,109 @@
 
 #include "isfqt-internal.h"
 
+#include <QMutexLocker>
 #include <QPainterPath>
+#include <QSharedData>
 
 
 using namespace Isf;
 
 
 
+namespace Isf
+{
+
+
+
+  /**
+   * Deleter for the objects which a stroke links to, but doesn't own.
+   */
+  template<typename T>
+  static void doNotDelete( T* )
+  {
+  }
+
+
+
+  /**
+   * Implicitly shared data of a Stroke.
+   *
+   * The bezier data is a cache which is filled when the stroke is painted,
+   * so copies sharing the data can fill it at the same time.
+   */
+  struct StrokeData : public QSharedData
+  {
+    StrokeData()
+    : finalized( true )
+    , hasPressureData( false )
+    {
+    }
+
+    StrokeData( const StrokeData& other )
+    : QSharedData( other )
+    , boundingRect( other.boundingRect )
+    , channels( other.channels )
+    , color( other.color )
+    , finalized( other.finalized )
+    , flags( other.flags )
+    , hasPressureData( other.hasPressureData )
+    , metrics( other.metrics )
+    , penSize( other.penSize )
+    , pressure( other.pressure )
+    , transform( other.transform )
+    , x( other.x )
+    , y( other.y )
+    {
+      QMutexLocker locker( &other.bezierMutex );
+
+      bezierControlPoints1 = other.bezierControlPoints1;
+      bezierControlPoints2 = other.bezierControlPoints2;
+      bezierKnots          = other.bezierKnots;
+    }
+
+    /// Bezier data
+    mutable QList<QPointF>    bezierControlPoints1;
+    mutable QList<QPointF>    bezierControlPoints2;
+    mutable QList<QPointF>    bezierKnots;
+    /// Guards the bezier data
+    mutable QMutex            bezierMutex;
+    /// Bounding rectangle of this stroke
+    QRect                     boundingRect;
+    /// Values of the packet properties other than coordinates and pressure
+    QMap<int,QVector<qint64> > channels;
+    /// The stroke color, optionally with alpha channel
+    QColor                    color;
+    /// Whether the stroke data needs to be analyzed or not
+    bool                      finalized;
+    /// Mask of StrokeFlags, @see StrokeFlags
+    StrokeFlags               flags;
+    /// Whether the stroke contains pressure information or not
+    bool                      hasPressureData;
+    /// Link to this stroke's metrics, if any
+    QSharedPointer<Metrics>   metrics;
+    /// Dimensions of the pencil in pixels
+    QSizeF                    penSize;
+    /// Pressure level of each point, empty if the stroke has no pressure data
+    QVector<qint64>           pressure;
+    /// Link to this stroke's transformation, if any
+    QSharedPointer<QMatrix>   transform;
+    /// X coordinate of each point
+    QVector<qint32>           x;
+    /// Y coordinate of each point
+    QVector<qint32>           y;
+  };
+
+
+
+}
+
+
+
 /**
  * Constructor
  */
 Stroke::Stroke()
-: finalized_( true )
-, metrics_( 0 )
-, transform_( 0 )
+: d_( new StrokeData() )
 {
 }
 
@@ -47,23 +136,28 @@ Stroke::Stroke()
 /**
  * Copy constructor
  *
- * @param other The object to clone
+ * The stroke data is shared until either copy gets changed.
+ *
+ * @param other The object to copy
  */
 Stroke::Stroke( const Stroke& other )
+: d_( other.d_ )
 {
-  bezierControlPoints1_ = other.bezierControlPoints1_;
-  bezierControlPoints2_ = other.bezierControlPoints2_;
-  bezierKnots_ = other.bezierKnots_;
+}
+
 
-  boundingRect_ = other.boundingRect_;
-  color_ = other.color_;
-  finalized_ = other.finalized_;
-  flags_ = other.flags_;
-  hasPressureData_ = other.hasPressureData_;
-  metrics_ = other.metrics_;
-  penSize_ = other.penSize_;
-  points_ = other.points_;
-  transform_ = other.transform_;
+
+/**
+ * Move constructor
+ *
+ * The other stroke is left as an empty stroke.
+ *
+ * @param other The object to move
+ */
+Stroke::Stroke( Stroke&& other )
+: d_( new StrokeData() )
+{
+  d_.swap( other.d_ );
 }
 
 
@@ -77,6 +171,43 @@ Stroke::~Stroke()
 
 
 
+/**
+ * Assignment operator
+ *
+ * The stroke data is shared until either copy gets changed.
+ *
+ * @param other The object to copy
+ * @return This stroke
+ */
+Stroke& Stroke::operator =( const Stroke& other )
+{
+  d_ = other.d_;
+  return *this;
+}
+
+
+
+/**
+ * Move assignment operator
+ *
+ * The two strokes swap their data.
+ *
+ * @param other The object to move
+ * @return This stroke
+ */
+Stroke& Stroke::operator =( Stroke&& other )
+{
+  d_.swap( other.d_ );
+  return *this;
+}
+
+
+
+/**
+ * Add a point to the stroke.
+ *
+ * @param point The point to add
+ */
 void Stroke::addPoint( const Point& point )
 {
   // Avoid splitting up the logic
@@ -85,24 +216,102 @@ void Stroke::addPoint( const Point& point )
 
 
 
+/**
+ * Add a list of points to the stroke.
+ *
+ * @param points The points to add
+ */
 void Stroke::addPoints( const PointList& points )
 {
-  points_.append( points );
+  const int count = points.count();
+
+  QVector<qint32> x( count );
+  QVector<qint32> y( count );
+  QVector<qint64> pressure;
+
+  for( int index = 0; index < count; ++index )
+  {
+    const Point& point = points.at( index );
+
+    x[ index ] = point.position.x();
+    y[ index ] = point.position.y();
+
+    // Only keep pressure levels if there is any
+    if( point.pressureLevel != 0 && pressure.isEmpty() )
+    {
+      pressure.resize( count );
+    }
+    if( ! pressure.isEmpty() )
+    {
+      pressure[ index ] = point.pressureLevel;
+    }
+  }
+
+  addPoints( x, y, pressure );
+}
+
+
+
+/**
+ * Add points to the stroke, from arrays of coordinates.
+ *
+ * If the arrays have different sizes, the extra values are ignored.
+ * When the stroke is empty, the arrays are shared rather than copied.
+ *
+ * @param x X coordinates of the points
+ * @param y Y coordinates of the points
+ * @param pressure Pressure levels of the points, or an empty array if there are none
+ */
+void Stroke::addPoints( const QVector<qint32>& x, const QVector<qint32>& y, const QVector<qint64>& pressure )
+{
+  const int oldCount = d_->x.size();
+  const int count    = qMin( x.size(), y.size() );
+
+  if( count == 0 )
+  {
+    return;
+  }
+
+  if( oldCount == 0 && x.size() == count && y.size() == count )
+  {
+    d_->x = x;
+    d_->y = y;
+  }
+  else
+  {
+    d_->x += x.mid( 0, count );
+    d_->y += y.mid( 0, count );
+  }
 
   // Hunt for pressure info
-  if( ! hasPressureData_ )
+  if( ! d_->hasPressureData )
   {
-    foreach( Point point, points )
+    for( int index = 0; index < qMin( count, pressure.size() ); ++index )
     {
-      if( point.pressureLevel != 0 )
+      if( pressure[ index ] != 0 )
       {
-        hasPressureData_ = true;
+        d_->hasPressureData = true;
+
+        // The points added before had no pressure
+        d_->pressure.fill( 0, oldCount );
         break;
       }
     }
   }
 
-  finalized_ = false;
+  if( d_->hasPressureData && d_->pressure.isEmpty() && pressure.size() == count )
+  {
+    d_->pressure = pressure;
+  }
+  else if( d_->hasPressureData )
+  {
+    d_->pressure += pressure.mid( 0, count );
+
+    // Points without a pressure level get zero
+    d_->pressure.resize( d_->x.size() );
+  }
+
+  d_->finalized = false;
 }
 
 
@@ -111,13 +320,13 @@ void Stroke::addPoints( const PointList& points )
  * Given a series of known (knot) points, knots, calculates the control points (c1, c2) to approximate a series of
  * bezier curves passing smoothly through the knot points.
  */
-void Stroke::bezierCalculateControlPoints()
+void Stroke::bezierCalculateControlPoints() const
 {
-//   bezierKnots_.clear();
-//   bezierControlPoints1_.clear();
-//   bezierControlPoints2_.clear();
+//   d_->bezierKnots.clear();
+//   d_->bezierControlPoints1.clear();
+//   d_->bezierControlPoints2.clear();
 
-  int numPoints = points_.size();
+  int numPoints = d_->x.size();
 
   // For a better curve, don't pass through all of points:
   // skip about 70% of them
@@ -127,20 +336,20 @@ void Stroke::bezierCalculateControlPoints()
 
   for( int i = 0; i < numPoints; i += step )
   {
-    bezierKnots_.append( points_.at(i).position );
+    d_->bezierKnots.append( QPointF( d_->x[ i ], d_->y[ i ] ) );
   }
 
   // always pass through the last point.
-  bezierKnots_.append( points_.last().position );
+  d_->bezierKnots.append( QPointF( d_->x.last(), d_->y.last() ) );
 
   /////////////////////////////////////////////////////////////////////////////
 
-  if( bezierKnots_.empty())
+  if( d_->bezierKnots.empty())
   {
     return;
   }
 
-  int n = bezierKnots_.size() - 1;
+  int n = d_->bezierKnots.size() - 1;
   if( n < 1 )
   {
 #ifdef ISFQT_DEBUG
@@ -153,8 +362,8 @@ void Stroke::bezierCalculateControlPoints()
   if( n == 1 )
   {
     QPointF cp1, cp2;
-    QPointF k1 = bezierKnots_.at(0);   // knot point 1
-    QPointF k2 = bezierKnots_.at(1);   // knot point 2
+    QPointF k1 = d_->bezierKnots.at(0);   // knot point 1
+    QPointF k2 = d_->bezierKnots.at(1);   // knot point 2
 
     cp1.setX( ( 2 * k1.x() + k2.x() ) / 3.0 );
     cp1.setY( ( 2 * k1.y() + k2.y() ) / 3.0 );
@@ -162,8 +371,8 @@ void Stroke::bezierCalculateControlPoints()
     cp2.setX( ( 2 * cp1.x() - k1.x() ) );
     cp2.setY( ( 2 * cp1.y() - k1.y() ) );
 
-    bezierControlPoints1_.append( cp1 );
-    bezierControlPoints2_.append( cp2 );
+    d_->bezierControlPoints1.append( cp1 );
+    d_->bezierControlPoints2.append( cp2 );
 
     return; // done!
   }
@@ -175,11 +384,11 @@ void Stroke::bezierCalculateControlPoints()
   // set RHS x values
   for( int i = 1; i < n-1; i++ )
   {
-    rhs.at(i) = 4 * bezierKnots_.at(i).x() + 2 * bezierKnots_.at(i+1).x();
+    rhs.at(i) = 4 * d_->bezierKnots.at(i).x() + 2 * d_->bezierKnots.at(i+1).x();
   }
 
-  rhs.at(0) = bezierKnots_.at(0).x() + 2 * bezierKnots_.at(1).x();
-  rhs.at(n-1) = ( 8 * bezierKnots_.at(n-1).x() + bezierKnots_.at(n).x() ) / 2.0;
+  rhs.at(0) = d_->bezierKnots.at(0).x() + 2 * d_->bezierKnots.at(1).x();
+  rhs.at(n-1) = ( 8 * d_->bezierKnots.at(n-1).x() + d_->bezierKnots.at(n).x() ) / 2.0;
 
   // get the first ctl points x values.
   std::vector<double> x;
@@ -190,11 +399,11 @@ void Stroke::bezierCalculateControlPoints()
   // now set RHS y-values.
   for(int i = 1; i < n-1; i++ )
   {
-    rhs.at(i) = 4 * bezierKnots_[i].y() + 2 * bezierKnots_[i+1].y();
+    rhs.at(i) = 4 * d_->bezierKnots[i].y() + 2 * d_->bezierKnots[i+1].y();
   }
 
-  rhs.at(0) = bezierKnots_.at(0).y() + 2 * bezierKnots_.at(1).y();
-  rhs.at(n-1) = ( 8 * bezierKnots_.at(n-1).y() + bezierKnots_.at(n).y() ) / 2.0;
+  rhs.at(0) = d_->bezierKnots.at(0).y() + 2 * d_->bezierKnots.at(1).y();
+  rhs.at(n-1) = ( 8 * d_->bezierKnots.at(n-1).y() + d_->bezierKnots.at(n).y() ) / 2.0;
 
   std::vector<double> y;
   y.resize(n);
@@ -209,24 +418,24 @@ void Stroke::bezierCalculateControlPoints()
     // second ctl point
     if ( i < n-1 )
     {
-      cp2 = QPointF( 2 * bezierKnots_.at(i+1).x() - x.at(i+1),
-                    2 * bezierKnots_.at(i+1).y() - y.at(i+1) );
+      cp2 = QPointF( 2 * d_->bezierKnots.at(i+1).x() - x.at(i+1),
+                    2 * d_->bezierKnots.at(i+1).y() - y.at(i+1) );
     }
     else
     {
-      cp2 = QPointF( ( bezierKnots_.at(n).x() + x.at(n-1) ) / 2,
-                    ( bezierKnots_.at(n).y() + y.at(n-1) ) / 2 );
+      cp2 = QPointF( ( d_->bezierKnots.at(n).x() + x.at(n-1) ) / 2,
+                    ( d_->bezierKnots.at(n).y() + y.at(n-1) ) / 2 );
     }
 
-    bezierControlPoints1_.append( cp1 );
-    bezierControlPoints2_.append( cp2 );
+    d_->bezierControlPoints1.append( cp1 );
+    d_->bezierControlPoints2.append( cp2 );
   }
 }
 
 
 
 // Solves the system for the first control points.
-void Stroke::bezierGetFirstControlPoints( const std::vector<double>& rhs, std::vector<double>* xOut, int n )
+void Stroke::bezierGetFirstControlPoints( const std::vector<double>& rhs, std::vector<double>* xOut, int n ) const
 {
   std::vector<double>* x = xOut; // solution vector.
   x->resize(n);
@@ -261,14 +470,29 @@ void Stroke::bezierGetFirstControlPoints( const std::vector<double>& rhs, std::v
  */
 QRect Stroke::boundingRect() const
 {
-  return boundingRect_;
+  return d_->boundingRect;
+}
+
+
+
+/**
+ * Get the values of a packet property of all the points.
+ *
+ * X and Y coordinates and pressure levels have their own methods.
+ *
+ * @param property The packet property
+ * @return One value per point, or an empty array if the stroke has no such property
+ */
+QVector<qint64> Stroke::channel( PacketProperty property ) const
+{
+  return d_->channels.value( property );
 }
 
 
 
 QColor Stroke::color() const
 {
-  return color_;
+  return d_->color;
 }
 
 
@@ -281,34 +505,51 @@ QColor Stroke::color() const
  */
 void Stroke::finalize()
 {
-  if( finalized_ )
+  // Checking doesn't need a private copy of the data
+  if( d_.constData()->finalized )
   {
     return;
   }
 
-  // A polygon is used to determine the stroke's bounding rect
-  quint64 numPoints = points_.count();
-  QPolygon polygon( numPoints );
-  for( quint64 index = 0; index < numPoints; ++index )
+  const int numPoints = d_->x.size();
+  QRect rect;
+
+  if( d_->transform )
   {
-    polygon.setPoint( index, points_.at( index ).position );
-  }
+    // A polygon is used to determine the transformed stroke's bounding rect
+    QPolygon polygon( numPoints );
+    for( int index = 0; index < numPoints; ++index )
+    {
+      polygon.setPoint( index, d_->x[ index ], d_->y[ index ] );
+    }
 
-  // Transform the bounding rect with the current transformation
-  if( transform_ )
+    rect = d_->transform->map( polygon ).boundingRect();
+  }
+  else if( numPoints > 0 )
   {
-    polygon = transform_->map( polygon );
+    qint32 left = d_->x[ 0 ], right  = d_->x[ 0 ];
+    qint32 top  = d_->y[ 0 ], bottom = d_->y[ 0 ];
+
+    for( int index = 1; index < numPoints; ++index )
+    {
+      left   = qMin( left,   d_->x[ index ] );
+      right  = qMax( right,  d_->x[ index ] );
+      top    = qMin( top,    d_->y[ index ] );
+      bottom = qMax( bottom, d_->y[ index ] );
+    }
+
+    rect = QRect( QPoint( left, top ), QPoint( right, bottom ) );
   }
 
   // Set the bounding rectangle, expanded it to also accommodate pen size
-  float halfPenSize = penSize_.width() / 2;
-  boundingRect_ = polygon.boundingRect().adjusted( -( halfPenSize ), -( halfPenSize ),
-                                                      halfPenSize,      halfPenSize );
+  float halfPenSize = d_->penSize.width() / 2;
+  d_->boundingRect = rect.adjusted( -( halfPenSize ), -( halfPenSize ),
+                                    halfPenSize,      halfPenSize );
 
   // Finally, pre-calculate the stroke paths
   painterPath();
 
-  finalized_ = true;
+  d_->finalized = true;
 }
 
 
@@ -320,7 +561,7 @@ void Stroke::finalize()
  */
 StrokeFlags Stroke::flags() const
 {
-  return flags_;
+  return d_->flags;
 }
 
 
@@ -332,7 +573,7 @@ StrokeFlags Stroke::flags() const
  */
 bool Stroke::hasPressureData() const
 {
-  return hasPressureData_;
+  return d_->hasPressureData;
 }
 
 
@@ -342,9 +583,9 @@ bool Stroke::hasPressureData() const
  *
  * @return Metrics*
  */
-Metrics* Stroke::metrics()
+Metrics* Stroke::metrics() const
 {
-  return metrics_;
+  return d_->metrics.data();
 }
 
 
@@ -358,42 +599,47 @@ Metrics* Stroke::metrics()
  * If the FitToCurve flag is present, the stroke path is generated using bezier curves
  * to approximate the stroke, giving a much smoother appearance.
  *
+ * The bezier curves are cached, and copies of the stroke which share its
+ * data can be painted from different threads.
+ *
  * @see calculateControlPoints()
  * @return QPainterPath
  */
-QPainterPath Stroke::painterPath()
+QPainterPath Stroke::painterPath() const
 {
-  int numPoints = points_.size();
+  int numPoints = d_->x.size();
 
   if( numPoints == 0 )
   {
     return QPainterPath();
   }
 
-  QPointF startPos( points_.first().position );
+  QPointF startPos( d_->x.first(), d_->y.first() );
 
   QPainterPath path( startPos );
 
-  if( ( flags_ & FitToCurve ) == false )
+  if( ( d_->flags & FitToCurve ) == false )
   {
-    foreach( Point point, points_ )
+    for( int i = 0; i < numPoints; ++i )
     {
-      path.lineTo( point.position );
+      path.lineTo( d_->x[ i ], d_->y[ i ] );
     }
     return path;
   }
 
+  QMutexLocker locker( &d_->bezierMutex );
+
   // don't calculate control points if they've
   // already been calculated.
-  if( bezierKnots_.isEmpty() )
+  if( d_->bezierKnots.isEmpty() )
   {
     bezierCalculateControlPoints();
   }
 
-  for( int i = 0; i < bezierControlPoints1_.size(); i++ )
+  for( int i = 0; i < d_->bezierControlPoints1.size(); i++ )
   {
     // draw the bezier curve!
-    path.cubicTo( bezierControlPoints1_[ i ], bezierControlPoints2_[ i ], bezierKnots_[ i + 1 ] );
+    path.cubicTo( d_->bezierControlPoints1[ i ], d_->bezierControlPoints2[ i ], d_->bezierKnots[ i + 1 ] );
   }
 
   return path;
@@ -408,7 +654,19 @@ QPainterPath Stroke::painterPath()
  */
 QSizeF Stroke::penSize() const
 {
-  return penSize_;
+  return d_->penSize;
+}
+
+
+
+/**
+ * Get the number of points
+ *
+ * @return Number of stroke points
+ */
+int Stroke::pointCount() const
+{
+  return d_->x.size();
 }
 
 
@@ -416,11 +674,62 @@ QSizeF Stroke::penSize() const
 /**
  * Get the list of points
  *
+ * The list is built from the coordinate arrays on every call: when
+ * going through the points of large strokes, use xPositions(),
+ * yPositions() and pressureLevels() instead.
+ *
+ * The list is a read-only copy: changing it would not change the stroke,
+ * so it is returned as const to make such code fail to compile. Use
+ * addPoint() and addPoints() to add points.
+ *
  * @return List of stroke points
  */
-PointList& Stroke::points()
+const PointList Stroke::points() const
+{
+  const int numPoints = d_->x.size();
+
+  PointList points;
+  points.reserve( numPoints );
+
+  for( int index = 0; index < numPoints; ++index )
+  {
+    points.append( Point( QPoint( d_->x[ index ], d_->y[ index ] ),
+                          d_->hasPressureData ? d_->pressure[ index ] : 0 ) );
+  }
+
+  return points;
+}
+
+
+
+/**
+ * Get the pressure level of each point
+ *
+ * @return Array of pressure levels, empty if the stroke has no pressure data
+ */
+const QVector<qint64>& Stroke::pressureLevels() const
+{
+  return d_->pressure;
+}
+
+
+
+/**
+ * Change the values of a packet property of all the points.
+ *
+ * @param property The packet property
+ * @param values One value per point, or an empty array to remove the property
+ */
+void Stroke::setChannel( PacketProperty property, const QVector<qint64>& values )
 {
-  return points_;
+  if( values.isEmpty() )
+  {
+    d_->channels.remove( property );
+  }
+  else
+  {
+    d_->channels.insert( property, values );
+  }
 }
 
 
@@ -432,7 +741,7 @@ PointList& Stroke::points()
  */
 void Stroke::setColor( QColor newColor )
 {
-  color_ = newColor;
+  d_->color = newColor;
 }
 
 
@@ -448,11 +757,11 @@ void Stroke::setFlag( StrokeFlag flag, bool set )
 {
   if( set )
   {
-    flags_ |= flag;
+    d_->flags |= flag;
   }
   else
   {
-    flags_ ^= flag;
+    d_->flags ^= flag;
   }
 }
 
@@ -465,19 +774,35 @@ void Stroke::setFlag( StrokeFlag flag, bool set )
  */
 void Stroke::setFlags( StrokeFlags newFlags )
 {
-  flags_ = newFlags;
+  d_->flags = newFlags;
 }
 
 
 
 /**
- * Get the current pen size
+ * Set the stroke metrics.
+ *
+ * The stroke doesn't take ownership of the metrics.
  *
  * @param newMetrics The new metrics object
  */
 void Stroke::setMetrics( Metrics* newMetrics )
 {
-  metrics_ = newMetrics;
+  d_->metrics = QSharedPointer<Metrics>( newMetrics, doNotDelete<Metrics> );
+}
+
+
+
+/**
+ * Set the stroke metrics, sharing their ownership with the stroke.
+ *
+ * The metrics are deleted together with the last stroke or list using them.
+ *
+ * @param newMetrics The new metrics object
+ */
+void Stroke::setMetrics( const QSharedPointer<Metrics>& newMetrics )
+{
+  d_->metrics = newMetrics;
 }
 
 
@@ -489,10 +814,10 @@ void Stroke::setMetrics( Metrics* newMetrics )
  */
 void Stroke::setPenSize( QSizeF newSize )
 {
-  penSize_ = newSize;
+  d_->penSize = newSize;
 
   // The bounding box changes with pen size
-  finalized_ = false;
+  d_->finalized = false;
 }
 
 
@@ -506,7 +831,21 @@ void Stroke::setPenSize( QSizeF newSize )
  */
 void Stroke::setTransform( QMatrix* newTransform )
 {
-  transform_ = newTransform;
+  d_->transform = QSharedPointer<QMatrix>( newTransform, doNotDelete<QMatrix> );
+}
+
+
+
+/**
+ * Apply a transformation to the stroke, sharing its ownership with the stroke.
+ *
+ * The transformation is deleted together with the last stroke or list using it.
+ *
+ * @param newTransform Transformation to apply
+ */
+void Stroke::setTransform( const QSharedPointer<QMatrix>& newTransform )
+{
+  d_->transform = newTransform;
 }
 
 
@@ -516,9 +855,33 @@ void Stroke::setTransform( QMatrix* newTransform )
  *
  * @return QMatrix, possibly null
  */
-QMatrix* Stroke::transform()
+QMatrix* Stroke::transform() const
+{
+  return d_->transform.data();
+}
+
+
+
+/**
+ * Get the X coordinate of each point
+ *
+ * @return Array of X coordinates
+ */
+const QVector<qint32>& Stroke::xPositions() const
+{
+  return d_->x;
+}
+
+
+
+/**
+ * Get the Y coordinate of each point
+ *
+ * @return Array of Y coordinates
+ */
+const QVector<qint32>& Stroke::yPositions() const
 {
-  return transform_;
+  return d_->y;
 }
 
 
@@ -0,0 +1,94 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by the Isf-Qt developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License as        *
+ *   published by the Free Software Foundation; either version 2.1 of the  *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU Lesser General Public      *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include "parallel.h"
+
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThreadPool>
+
+
+using namespace Isf;
+
+
+
+/**
+ * Runs a worker function in a thread of the pool.
+ */
+class WorkerRunnable : public QRunnable
+{
+  public:
+    WorkerRunnable( const std::function<void()>& worker, QSemaphore* finished )
+    : finished_( finished )
+    , worker_( worker )
+    {
+    }
+
+    void run()
+    {
+      worker_();
+      finished_->release();
+    }
+
+  private:
+    /// Released when the worker is done
+    QSemaphore*                  finished_;
+    /// The function to run
+    const std::function<void()>& worker_;
+};
+
+
+
+/**
+ * Run a function in the calling thread and in the idle threads of the pool.
+ *
+ * The function is run by up to maxWorkers threads at the same time, and it
+ * is up to it to split the work with the other threads: usually, by taking
+ * the next item from a shared atomic index until there are none left.
+ *
+ * Only the threads which are free right now are used, so that this can't
+ * wait forever when called from a thread of the pool itself.
+ *
+ * @param worker The function to run
+ * @param maxWorkers Maximum number of threads to use, including the calling one
+ */
+void Isf::runInParallel( const std::function<void()>& worker, int maxWorkers )
+{
+  QSemaphore   finished;
+  QThreadPool* pool = QThreadPool::globalInstance();
+
+  int helpers = 0;
+  while( helpers < maxWorkers - 1 )
+  {
+    WorkerRunnable* runnable = new WorkerRunnable( worker, &finished );
+    if( ! pool->tryStart( runnable ) )
+    {
+      delete runnable;
+      break;
+    }
+
+    ++helpers;
+  }
+
+  worker();
+
+  finished.acquire( helpers );
+}
+
+
@@ -28,10 +28,12 @@
 #include "data/multibytecoding.h"
 
 #include "isfqt-internal.h"
+#include "parallel.h"
 
 #include <IsfQt>
 #include <IsfQtDrawing>
 
+#include <QAtomicInt>
 #include <QPolygon>
 #include <QUuid>
 
@@ -40,6 +42,10 @@ using namespace Isf;
 using namespace Isf::Compress;
 
 
+/// Stroke payloads are decompressed by one more thread for every this many bytes
+#define PARALLEL_STROKES_MIN_BYTES  ( 64 * 1024 )
+
+
 
 /**
  * Read away an unsupported tag.
@@ -112,16 +118,16 @@ IsfError TagsParser::nextTag( StreamData* streamData, Drawing* drawing )
 #ifdef ISFQT_DEBUG_VERBOSE
       qDebug() << "Got tag (@" << place << "): TAG_NO_X";
 #endif
-      drawing->error_ = ISF_ERROR_NONE;
+      drawing->d_->error = ISF_ERROR_NONE;
 
-      drawing->hasXData_ = false;
+      drawing->d_->hasXData = false;
       break;
 
     case TAG_NO_Y:
 #ifdef ISFQT_DEBUG_VERBOSE
       qDebug() << "Got tag (@" << place << "): TAG_NO_Y";
 #endif
-      drawing->hasYData_ = false;
+      drawing->d_->hasYData = false;
       break;
 
     case TAG_DIDX:
@@ -265,7 +271,7 @@ IsfError TagsParser::nextTag( StreamData* streamData, Drawing* drawing )
 
       quint64 value = decodeUInt( streamData->dataSource );
 
-      if( value < (uint)streamData->transforms.count() )
+      if( value < (uint)streamData->sharedTransforms.count() )
       {
         streamData->currentTransformsIndex = value;
 
@@ -305,7 +311,7 @@ IsfError TagsParser::nextTag( StreamData* streamData, Drawing* drawing )
 
       quint64 value = decodeUInt( streamData->dataSource );
 
-      if( value < (uint)streamData->metrics.count() )
+      if( value < (uint)streamData->sharedMetrics.count() )
       {
         streamData->currentMetricsIndex = value;
 #ifdef ISFQT_DEBUG_VERBOSE
@@ -354,8 +360,8 @@ IsfError TagsParser::nextTag( StreamData* streamData, Drawing* drawing )
     default:
 
       // If the tagIndex is known from the GUID table, show it differently
-      if( drawing->maxGuid_ > 0
-      &&  tagIndex >= DEFAULT_TAGS_NUMBER && tagIndex <= drawing->maxGuid_ )
+      if( drawing->d_->maxGuid > 0
+      &&  tagIndex >= DEFAULT_TAGS_NUMBER && tagIndex <= drawing->d_->maxGuid )
       {
 #ifdef ISFQT_DEBUG_VERBOSE
         qDebug() << "Got tag (@" << place << "): TAG_CUSTOM:" << tagIndex;
@@ -375,6 +381,102 @@ IsfError TagsParser::nextTag( StreamData* streamData, Drawing* drawing )
 
 
 
+/**
+ * Find out how many bytes the next tag takes, without reading it.
+ *
+ * Used to parse streams which arrive in pieces: a tag is only parsed once
+ * all of its bytes are available.
+ *
+ * @param data Bytes of the stream received so far
+ * @param pos Position of the tag within the data
+ * @param drawing Drawing being read, which knows the custom tags
+ * @param length Length of the whole tag, in bytes
+ * @return bool False if there are not enough bytes yet to know the length
+ */
+bool TagsParser::tagLength( const QByteArray& data, qint64 pos, const Drawing* drawing, quint64& length )
+{
+  const qint64 start = pos;
+  quint64      tagIndex;
+  quint64      value;
+  quint64      payloadSize = 0;
+
+  if( ! peekUInt( data, pos, tagIndex ) )
+  {
+    return false;
+  }
+
+  switch( tagIndex )
+  {
+    // Tags without a payload
+    case TAG_NO_X:
+    case TAG_NO_Y:
+    case TAG_TRANSFORM_QUAD:
+      break;
+
+    // Tags followed by a single value
+    case TAG_DIDX:
+    case TAG_SIDX:
+    case TAG_TIDX:
+    case TAG_MIDX:
+      if( ! peekUInt( data, pos, value ) )
+      {
+        return false;
+      }
+      break;
+
+    // The canvas is followed by its four coordinates
+    case TAG_INK_SPACE_RECT:
+      for( int index = 0; index < 4; ++index )
+      {
+        if( ! peekUInt( data, pos, value ) )
+        {
+          return false;
+        }
+      }
+      break;
+
+    // Transformations are followed by a fixed number of floats
+    case TAG_TRANSFORM_ISOTROPIC_SCALE:
+    case TAG_TRANSFORM_ROTATE:
+      payloadSize = 1 * sizeof( float );
+      break;
+
+    case TAG_TRANSFORM_ANISOTROPIC_SCALE:
+    case TAG_TRANSFORM_TRANSLATE:
+      payloadSize = 2 * sizeof( float );
+      break;
+
+    case TAG_TRANSFORM_SCALE_AND_TRANSLATE:
+      payloadSize = 4 * sizeof( float );
+      break;
+
+    case TAG_TRANSFORM:
+      payloadSize = 6 * sizeof( float );
+      break;
+
+    // All other tags start with the size of their payload
+    default:
+      if( ! peekUInt( data, pos, payloadSize ) )
+      {
+        return false;
+      }
+
+      // Custom tags have one more byte than they say
+      if( drawing->d_->maxGuid > 0
+      &&  tagIndex >= DEFAULT_TAGS_NUMBER && tagIndex <= drawing->d_->maxGuid )
+      {
+        ++payloadSize;
+      }
+      break;
+  }
+
+  length = ( pos - start ) + payloadSize;
+
+  return true;
+}
+
+
+
 /**
  * Read away an unsupported tag.
  *
@@ -409,7 +511,7 @@ IsfError TagsParser::parseCustomTag( StreamData* streamData, Drawing* drawing, q
   quint64 tag = tagIndex - FIRST_CUSTOM_TAG_ID;
 
   // Find if we have this tag registered in the GUID table
-  if( tag >= (quint64)drawing->guids_.count() )
+  if( tag >= (quint64)drawing->d_->guids.count() )
   {
 #ifdef ISFQT_DEBUG
     qDebug() << "Custom tag" << QString::number( tagIndex ) << "was not registered!";
@@ -418,12 +520,18 @@ IsfError TagsParser::parseCustomTag( StreamData* streamData, Drawing* drawing, q
   }
 
   QList<qint64> data;
-  QUuid         guid        = drawing->guids_.at( tag );
+  QUuid         guid        = drawing->d_->guids.at( tag );
   quint64       payloadSize = decodeUInt( streamData->dataSource ) + 1;
 
-  // Decompress the property data
-  DataSource payload( streamData->dataSource->getBytes( payloadSize ) );
-  Compress::inflatePropertyData( &payload, payloadSize-1, data );
+  // Decompress the property data, reading it in place
+  DataSource payload( streamData->dataSource->getRawBytes( payloadSize ) );
+  if( ! Compress::inflatePropertyData( &payload, payloadSize-1, data ) )
+  {
+#ifdef ISFQT_DEBUG
+    qDebug() << "Could not decompress the data of custom tag" << guid;
+#endif
+    return ISF_ERROR_NONE;
+  }
 
   // String values
   if(
@@ -432,7 +540,10 @@ IsfError TagsParser::parseCustomTag( StreamData* streamData, Drawing* drawing, q
      )
   {
     // TODO: WTF is the first char for? Its value is always "0x08"
-    data.takeAt( 0 );
+    if( ! data.isEmpty() )
+    {
+      data.removeFirst();
+    }
 
     QString string;
 
@@ -473,7 +584,7 @@ IsfError TagsParser::parseCustomTag( StreamData* streamData, Drawing* drawing, q
  */
 IsfError TagsParser::parseGuidTable( StreamData* streamData, Drawing* drawing )
 {
-  if( ! drawing->guids_.isEmpty() )
+  if( ! drawing->d_->guids.isEmpty() )
   {
 #ifdef ISFQT_DEBUG
     qDebug() << "Duplicated TAG_GUID_TABLE!";
@@ -486,10 +597,10 @@ IsfError TagsParser::parseGuidTable( StreamData* streamData, Drawing* drawing )
   // GUIDs are 16 bytes long
   quint8 numGuids = guidTableSize / 16;
   // Maximum GUID present in the file
-  drawing->maxGuid_ = 99 + numGuids;
+  drawing->d_->maxGuid = 99 + numGuids;
 
 #ifdef ISFQT_DEBUG_VERBOSE
-  qDebug() << "- New maximum GUID index:" << drawing->maxGuid_;
+  qDebug() << "- New maximum GUID index:" << drawing->d_->maxGuid;
   qDebug() << "- GUID table has" << numGuids << "entries for total" << guidTableSize << "bytes:";
 #endif
 
@@ -534,9 +645,9 @@ IsfError TagsParser::parseGuidTable( StreamData* streamData, Drawing* drawing )
                 block4[0], block4[1], block4[2], block4[3],
                 block4[4], block4[5], block4[6], block4[7] );
 
-    drawing->guids_.append( guid );
+    drawing->d_->guids.append( guid );
 
-    if( index != ( drawing->guids_.count() - 1 ) )
+    if( index != ( drawing->d_->guids.count() - 1 ) )
     {
 #ifdef ISFQT_DEBUG_VERBOSE
       qDebug() << "  - Tag/index mismatch!";
@@ -816,7 +927,7 @@ IsfError TagsParser::parseAttributeBlock( StreamData* streamData, Drawing* drawi
 #endif
 
         // If the tag *should* be known, record it differently
-        if( drawing->maxGuid_ > 0 && property >= 100 && property <= drawing->maxGuid_ )
+        if( drawing->d_->maxGuid > 0 && property >= 100 && property <= drawing->d_->maxGuid )
         {
           analyzePayload( streamData, "TAG_PROPERTY_" + QString::number( property ) );
         }
@@ -830,13 +941,13 @@ IsfError TagsParser::parseAttributeBlock( StreamData* streamData, Drawing* drawi
 
   // Update the drawing's maximum pen size.
   // This value is used to adjust the drawing borders to include thick strokes
-  if( set.penSize.width() > drawing->maxPenSize_.width() )
+  if( set.penSize.width() > drawing->d_->maxPenSize.width() )
   {
-    drawing->maxPenSize_.setWidth( set.penSize.width() );
+    drawing->d_->maxPenSize.setWidth( set.penSize.width() );
   }
-  if( set.penSize.height() > drawing->maxPenSize_.height() )
+  if( set.penSize.height() > drawing->d_->maxPenSize.height() )
   {
-    drawing->maxPenSize_.setHeight( set.penSize.height() );
+    drawing->d_->maxPenSize.setHeight( set.penSize.height() );
   }
 
   streamData->attributeSets.append( set );
@@ -890,7 +1001,7 @@ IsfError TagsParser::parseAttributeTable( StreamData* streamData, Drawing* drawi
  */
 IsfError TagsParser::parseInkSpaceRectangle( StreamData* streamData, Drawing* drawing )
 {
-  if( drawing->canvas_.isValid() )
+  if( drawing->d_->canvas.isValid() )
   {
 #ifdef ISFQT_DEBUG
     qDebug() << "Duplicated TAG_INK_SPACE_RECT!";
@@ -900,13 +1011,13 @@ IsfError TagsParser::parseInkSpaceRectangle( StreamData* streamData, Drawing* dr
 
   // This tag has a fixed 4-byte size
   DataSource* dataSource = streamData->dataSource;
-  drawing->canvas_.setLeft  ( decodeInt( dataSource ) );
-  drawing->canvas_.setTop   ( decodeInt( dataSource ) );
-  drawing->canvas_.setRight ( decodeInt( dataSource ) );
-  drawing->canvas_.setBottom( decodeInt( dataSource ) );
+  drawing->d_->canvas.setLeft  ( decodeInt( dataSource ) );
+  drawing->d_->canvas.setTop   ( decodeInt( dataSource ) );
+  drawing->d_->canvas.setRight ( decodeInt( dataSource ) );
+  drawing->d_->canvas.setBottom( decodeInt( dataSource ) );
 
 #ifdef ISFQT_DEBUG
-  qDebug() << "- Got drawing canvas:" << drawing->canvas_;
+  qDebug() << "- Got drawing canvas:" << drawing->d_->canvas;
 #endif
 
   return ISF_ERROR_NONE;
@@ -969,7 +1080,7 @@ IsfError TagsParser::parseMetricBlock( StreamData* streamData, Drawing* drawing
     return ISF_ERROR_INVALID_PAYLOAD;
   }
 
-  Metrics* metricsList = new Metrics();
+  QSharedPointer<Metrics> metricsList( new Metrics() );
   qint64 payloadEnd = dataSource->pos() + payloadSize;
   while( dataSource->pos() < payloadEnd && ! dataSource->atEnd() )
   {
@@ -1046,7 +1157,7 @@ IsfError TagsParser::parseMetricBlock( StreamData* streamData, Drawing* drawing
   }
 
   // Save the obtained metrics
-  streamData->metrics.append( metricsList );
+  streamData->sharedMetrics.append( metricsList );
 
   // set this once when we get the first METRIC_BLOCK. then,
   // everytime we get a MIDX we can update it. if we don't do this
@@ -1109,7 +1220,7 @@ IsfError TagsParser::parseTransformation( StreamData* streamData, Drawing* drawi
 {
   Q_UNUSED( drawing );
 
-  QMatrix* transform = new QMatrix();
+  QSharedPointer<QMatrix> transform( new QMatrix() );
   DataSource* dataSource = streamData->dataSource;
 
   /*
@@ -1226,7 +1337,7 @@ IsfError TagsParser::parseTransformation( StreamData* streamData, Drawing* drawi
       return ISF_ERROR_INVALID_BLOCK;
   }
 
-  streamData->transforms.append( transform );
+  streamData->sharedTransforms.append( transform );
 
   // set this once when we get the first transformation. then,
   // everytime we get a TIDX we can update it. if we don't do this
@@ -1237,7 +1348,7 @@ IsfError TagsParser::parseTransformation( StreamData* streamData, Drawing* drawi
 //   }
 
 #ifdef ISFQT_DEBUG_VERBOSE
-  qDebug() << "- Added transform block #" << ( streamData->transforms.count() - 1 );
+  qDebug() << "- Added transform block #" << ( streamData->sharedTransforms.count() - 1 );
 #endif
 
   return ISF_ERROR_NONE;
@@ -1248,6 +1359,9 @@ IsfError TagsParser::parseTransformation( StreamData* streamData, Drawing* drawi
 /**
  * Read a stroke.
  *
+ * Only the stroke properties are read here: the payload with the points is
+ * skipped, and decompressed later by inflateStrokes().
+ *
  * @param streamData StreamData object with the stream data
  * @param drawing Drawing into which the data obtained from the tag should be read
  * @return IsfError
@@ -1256,7 +1370,7 @@ IsfError TagsParser::parseStroke( StreamData* streamData, Drawing* drawing )
 {
   DataSource* dataSource = streamData->dataSource;
   quint64 payloadSize = decodeUInt( dataSource );
-  quint64 initialPos = dataSource->pos();
+  qint64 initialPos = dataSource->pos();
 
   if( payloadSize == 0 )
   {
@@ -1266,63 +1380,17 @@ IsfError TagsParser::parseStroke( StreamData* streamData, Drawing* drawing )
     return ISF_ERROR_INVALID_PAYLOAD;
   }
 
-  // Get the number of points which comprise this stroke
-  quint64 numPoints = decodeUInt( dataSource );
-
-  QList<qint64> xPointsData, yPointsData, pressureData;
-
-  // If the stream has pressure info, parse it
-  bool streamHasPressureData = streamData->strokeInfos.count() && streamData->strokeInfos.last()->hasPressureData;
-
-#ifdef ISFQT_DEBUG_VERBOSE
-  qDebug() << "- Tag size:" << payloadSize << "Points stored:" << numPoints;
-#endif
-
-  if( ! Compress::inflatePacketData( dataSource, numPoints, xPointsData ) )
-  {
-#ifdef ISFQT_DEBUG
-    qWarning() << "Decompression failure while extracting X points data!";
-    return ISF_ERROR_INVALID_PAYLOAD;
-#endif
-  }
-
-  if( ! Compress::inflatePacketData( dataSource, numPoints, yPointsData ) )
+  if( payloadSize > (quint64)( dataSource->size() - initialPos ) )
   {
 #ifdef ISFQT_DEBUG
-    qWarning() << "Decompression failure while extracting Y points data!";
-    return ISF_ERROR_INVALID_PAYLOAD;
+    qDebug() << "The TAG_STROKE payload of" << payloadSize << "bytes exceeds the stream!";
 #endif
-  }
-
-  if(   streamHasPressureData
-  &&  ! Compress::inflatePacketData( dataSource, numPoints, pressureData ) )
-  {
-#ifdef ISFQT_DEBUG
-    qWarning() << "Decompression failure while extracting pressure data!";
     return ISF_ERROR_INVALID_PAYLOAD;
-#endif
-  }
-
-  if( (uint)xPointsData.size() != numPoints || (uint)yPointsData.size() != numPoints )
-  {
-#ifdef ISFQT_DEBUG
-    qWarning() << "The points arrays have sizes x=" << xPointsData.size() << "y=" << yPointsData.size()
-              << "which do not match with the advertised size of" << numPoints;
-#endif
-  }
-
-  if( streamHasPressureData
-  &&  (uint)pressureData.size() != numPoints )
-  {
-#ifdef ISFQT_DEBUG
-    qWarning() << "The pressure data has a size of" << pressureData.size()
-              << "which does not match with the advertised size of" << numPoints;
-#endif
   }
 
   // Add a new stroke
-  drawing->strokes_.append( new Stroke() );
-  Stroke* stroke = drawing->strokes_.last();
+  drawing->d_->strokes.append( new Stroke() );
+  Stroke* stroke = drawing->d_->strokes.last();
 
   // Apply the stroke style, transforms and metrics
   if( streamData->attributeSets.count() )
@@ -1333,9 +1401,9 @@ IsfError TagsParser::parseStroke( StreamData* streamData, Drawing* drawing )
     stroke->setFlags  ( set.flags   );
     stroke->setPenSize( set.penSize );
   }
-  if( streamData->metrics.count() )
+  if( streamData->sharedMetrics.count() )
   {
-    Metrics* metrics = streamData->metrics.at( streamData->currentMetricsIndex );
+    QSharedPointer<Metrics> metrics( streamData->sharedMetrics.at( streamData->currentMetricsIndex ) );
 
     if( ! metrics )
     {
@@ -1346,9 +1414,9 @@ IsfError TagsParser::parseStroke( StreamData* streamData, Drawing* drawing )
       stroke->setMetrics( metrics );
     }
   }
-  if( streamData->transforms.count() )
+  if( streamData->sharedTransforms.count() )
   {
-    QMatrix* transform = streamData->transforms.at( streamData->currentTransformsIndex );
+    QSharedPointer<QMatrix> transform( streamData->sharedTransforms.at( streamData->currentTransformsIndex ) );
 
     if( ! transform )
     {
@@ -1361,38 +1429,108 @@ IsfError TagsParser::parseStroke( StreamData* streamData, Drawing* drawing )
   }
 
 #ifdef ISFQT_DEBUG_VERBOSE
-  qDebug() << "- Added stroke #" << ( drawing->strokes_.count() - 1 );
+  qDebug() << "- Added stroke #" << ( drawing->d_->strokes.count() - 1 ) << "- Tag size:" << payloadSize;
 #endif
 
-  // Add the points to the stroke
-  PointList list;
-  for( quint64 i = 0; i < numPoints; ++i )
+  // Remember where the points are, and move on to the next tag
+  PendingStroke pending;
+  pending.hasPressureData = streamData->strokeInfos.count() && streamData->strokeInfos.last().hasPressureData;
+  pending.payload         = dataSource->getRawBytes( payloadSize );
+  pending.stroke          = stroke;
+  streamData->pendingStrokes.append( pending );
+
+  return ISF_ERROR_NONE;
+}
+
+
+
+/**
+ * Decompress the points of the strokes found in the stream.
+ *
+ * When loading lazily, the strokes are left compressed instead, and the
+ * drawing keeps their points until they are needed.
+ *
+ * @param streamData StreamData object with the stream data
+ * @param drawing Drawing which contains the strokes
+ * @return IsfError
+ */
+IsfError TagsParser::inflateStrokes( StreamData* streamData, Drawing* drawing )
+{
+  if( streamData->lazyLoading )
   {
-    list.append( Point() );
-    Point &point = list.last();
+    foreach( PendingStroke pending, streamData->pendingStrokes )
+    {
+      // The stream goes away after parsing, keep a copy of the points
+      pending.payload = QByteArray( pending.payload.constData(), pending.payload.size() );
+      drawing->d_->pendingStrokes.insert( pending.stroke, pending );
+    }
+
+    streamData->pendingStrokes.clear();
+    return ISF_ERROR_NONE;
+  }
 
-    point.position.setX( xPointsData[ i ] );
-    point.position.setY( yPointsData[ i ] );
+  IsfError error = inflateStrokes( streamData->pendingStrokes );
 
-    if( streamHasPressureData )
+  // Update the entire drawing's bounding rect, like lazily loaded drawings do.
+  // The pen sizes are all known before the strokes, so the margin is the same
+  // for the strokes read so far and the new ones
+  if( ! streamData->pendingStrokes.isEmpty() )
+  {
+    QList<Stroke*> strokes;
+    foreach( const PendingStroke& pending, streamData->pendingStrokes )
     {
-      point.pressureLevel = pressureData[ i ];
+      strokes.append( pending.stroke );
     }
+
+    drawing->d_->boundingRect = drawing->d_->boundingRect.united( drawing->d_->strokesBoundingRect( strokes ) );
+  }
+
+  streamData->pendingStrokes.clear();
+
+  return error;
+}
+
+
+
+/**
+ * Decompress the points of some strokes.
+ *
+ * Each stroke payload is independent from the others, so big drawings get
+ * their strokes decompressed by multiple threads at once.
+ *
+ * @param pendingStrokes The strokes to decompress
+ * @return IsfError
+ */
+IsfError TagsParser::inflateStrokes( const QList<PendingStroke>& pendingStrokes )
+{
+  // Small drawings are not worth the threads
+  quint64 totalSize = 0;
+  foreach( const PendingStroke& pending, pendingStrokes )
+  {
+    totalSize += pending.payload.size();
   }
-  // And finish it out
-  stroke->addPoints( list );
-  stroke->finalize();
 
-  // Update the entire drawing's bounding rect
-  drawing->boundingRect_ = drawing->boundingRect_.united( stroke->boundingRect() );
+  QAtomicInt nextIndex( 0 );
+  QAtomicInt failures( 0 );
+
+  runInParallel( [&]()
+  {
+    int index;
+    while( ( index = nextIndex.fetchAndAddRelaxed( 1 ) ) < pendingStrokes.count() )
+    {
+      if( ! inflateStroke( pendingStrokes.at( index ) ) )
+      {
+        failures.ref();
+      }
+    }
+  }, 1 + (int)qMin( totalSize / PARALLEL_STROKES_MIN_BYTES, (quint64)pendingStrokes.count() ) );
 
-  qint64 remainingPayloadSize = payloadSize - ( dataSource->pos() - initialPos );
-  if( remainingPayloadSize > 0 )
+  if( failures.load() > 0 )
   {
-    analyzePayload( streamData,
-                    remainingPayloadSize,
-                    "Remaining stroke data: " + QString::number( remainingPayloadSize ) +
-                    " bytes" );
+#ifdef ISFQT_DEBUG
+    qWarning() << "Decompression failure in" << failures.load() << "strokes!";
+#endif
+    return ISF_ERROR_INVALID_PAYLOAD;
   }
 
   return ISF_ERROR_NONE;
@@ -1400,6 +1538,74 @@ IsfError TagsParser::parseStroke( StreamData* streamData, Drawing* drawing )
 
 
 
+/**
+ * Decompress the points of a stroke.
+ *
+ * This may be called by multiple threads at once, for different strokes.
+ *
+ * @param pending The stroke and its compressed points
+ * @return bool
+ */
+bool TagsParser::inflateStroke( const PendingStroke& pending )
+{
+  const quint64 payloadSize = pending.payload.size();
+
+  // Read the payload in place, without copying it
+  DataSource dataSource( pending.payload );
+
+  // Get the number of points which comprise this stroke
+  quint64 numPoints = decodeUInt( &dataSource );
+
+  // Every value takes at least a bit: a bigger amount of points can't be right,
+  // and would only make the buffers below huge
+  if( numPoints > payloadSize * 8 )
+  {
+#ifdef ISFQT_DEBUG
+    qWarning() << "The advertised size of" << numPoints << "points does not fit in the payload!";
+#endif
+    numPoints = payloadSize * 8;
+  }
+
+  // The values are decompressed straight into the arrays the stroke will use
+  QVector<qint32> xPositions( (int)numPoints );
+  QVector<qint32> yPositions( (int)numPoints );
+  QVector<qint64> pressureLevels( pending.hasPressureData ? (int)numPoints : 0 );
+  bool success = true;
+
+  if( ! Compress::inflatePacketData( &dataSource, numPoints, xPositions.data() ) )
+  {
+#ifdef ISFQT_DEBUG
+    qWarning() << "Decompression failure while extracting X points data!";
+#endif
+    success = false;
+  }
+
+  if( ! Compress::inflatePacketData( &dataSource, numPoints, yPositions.data() ) )
+  {
+#ifdef ISFQT_DEBUG
+    qWarning() << "Decompression failure while extracting Y points data!";
+#endif
+    success = false;
+  }
+
+  if(   pending.hasPressureData
+  &&  ! Compress::inflatePacketData( &dataSource, numPoints, pressureLevels.data() ) )
+  {
+#ifdef ISFQT_DEBUG
+    qWarning() << "Decompression failure while extracting pressure data!";
+#endif
+    success = false;
+  }
+
+  // Add the points to the stroke: the arrays are shared, not copied
+  pending.stroke->addPoints( xPositions, yPositions, pressureLevels );
+  pending.stroke->finalize();
+
+  return success;
+}
+
+
+
 /**
  * Read a stroke description block.
  *
@@ -1426,8 +1632,8 @@ IsfError TagsParser::parseStrokeDescBlock( StreamData* streamData, Drawing* draw
   qDebug() << "- Finding stroke description properties in the next" << payloadSize << "bytes";
 #endif
 
-  streamData->strokeInfos.append( new StrokeInfo() );
-  StrokeInfo* info = streamData->strokeInfos.last();
+  streamData->strokeInfos.append( StrokeInfo() );
+  StrokeInfo& info = streamData->strokeInfos.last();
 
   // set this once when we get the first TAG_STROKE_DESC_BLOCK. then,
   // everytime we get a SIDX we can update it. if we don't do this
@@ -1452,14 +1658,14 @@ IsfError TagsParser::parseStrokeDescBlock( StreamData* streamData, Drawing* draw
 #ifdef ISFQT_DEBUG_VERBOSE
         qDebug() << "- Stroke contains no X coordinates";
 #endif
-        info->hasXData = false;
+        info.hasXData = false;
         break;
 
       case TAG_NO_Y:
 #ifdef ISFQT_DEBUG_VERBOSE
         qDebug() << "- Stroke contains no Y coordinates";
 #endif
-        info->hasYData = false;
+        info.hasYData = false;
         break;
 
       case TAG_BUTTONS:
@@ -1478,7 +1684,7 @@ IsfError TagsParser::parseStrokeDescBlock( StreamData* streamData, Drawing* draw
 #ifdef ISFQT_DEBUG_VERBOSE
         qDebug() << "- Packet properties list:" << QString::number( tag, 10 );
 #endif
-        info->hasPressureData = true;
+        info.hasPressureData = true;
         // TODO How is this list made?
 /*
         for( quint64 i = 0; i < GUID_NUM; ++i )
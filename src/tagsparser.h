@@ -39,6 +39,7 @@ namespace Isf
   // Forward declarations
   class StreamData;
   class Drawing;
+  struct PendingStroke;
 
 
 
@@ -51,7 +52,10 @@ namespace Isf
   {
 
     public: // Static public methods
+      static IsfError inflateStrokes( StreamData* streamData, Drawing* drawing );
+      static IsfError inflateStrokes( const QList<PendingStroke>& pendingStrokes );
       static IsfError nextTag( StreamData* streamData, Drawing* drawing );
+      static bool     tagLength( const QByteArray& data, qint64 pos, const Drawing* drawing, quint64& length );
 
       static IsfError parseCustomTag( StreamData* streamData, Drawing* drawing, quint64 tagIndex );
       static IsfError parseGuidTable( StreamData* streamData, Drawing* drawing );
@@ -71,6 +75,9 @@ namespace Isf
     public: // Static public debugging methods
       static IsfError parseUnsupported( StreamData* streamData, const QString& tagName );
 
+    private: // Static private methods
+      static bool        inflateStroke( const PendingStroke& pending );
+
     private: // Static private debugging methods
       static QByteArray  analyzePayload( StreamData* streamData, const QString& tagName );
       static QByteArray  analyzePayload( StreamData* streamData, const quint64 payloadSize, const QString& message = QString() );
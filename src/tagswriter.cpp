@@ -24,6 +24,7 @@
 #include "tagswriter.h"
 
 #include "isfqt-internal.h"
+#include "parallel.h"
 
 #include "data/compression.h"
 #include "data/datasource.h"
@@ -31,11 +32,18 @@
 
 #include <IsfQtDrawing>
 
+#include <QAtomicInt>
+#include <QVector>
+
 
 using namespace Isf;
 using namespace Isf::Compress;
 
 
+/// Strokes are compressed by one more thread for every this many points
+#define PARALLEL_STROKES_MIN_POINTS  ( 16 * 1024 )
+
+
 
 /**
  * Write the persistent format tag.
@@ -52,9 +60,8 @@ IsfError TagsWriter::addPersistentFormat( StreamData* streamData, const Drawing*
 
   tagContents.append( encodeUInt( ISF_PERSISTENT_FORMAT_VERSION ) );
 
-  tagContents.prepend( encodeUInt( tagContents.size() ) );
-  tagContents.prepend( encodeUInt( TAG_PERSISTENT_FORMAT ) );
-
+  encodeUInt( streamData->dataSource, TAG_PERSISTENT_FORMAT );
+  encodeUInt( streamData->dataSource, tagContents.size() );
   streamData->dataSource->append( tagContents );
 
 #ifdef ISFQT_DEBUG_VERBOSE
@@ -211,7 +218,7 @@ IsfError TagsWriter::addAttributeTable( StreamData* streamData, const Drawing* d
     }
 
 
-    blockData.prepend( encodeUInt( blockData.size() ) );
+    tagContents.append( encodeUInt( blockData.size() ) );
     tagContents.append( blockData );
     blockData.clear();
 
@@ -222,12 +229,12 @@ IsfError TagsWriter::addAttributeTable( StreamData* streamData, const Drawing* d
 
   if( streamData->attributeSets.count() > 1 )
   {
-    tagContents.prepend( encodeUInt( tagContents.size() ) );
-    tagContents.prepend( encodeUInt( TAG_DRAW_ATTRS_TABLE ) );
+    encodeUInt( streamData->dataSource, TAG_DRAW_ATTRS_TABLE );
+    encodeUInt( streamData->dataSource, tagContents.size() );
   }
   else
   {
-    tagContents.prepend( encodeUInt( TAG_DRAW_ATTRS_BLOCK ) );
+    encodeUInt( streamData->dataSource, TAG_DRAW_ATTRS_BLOCK );
   }
 
   streamData->dataSource->append( tagContents );
@@ -287,13 +294,9 @@ IsfError TagsWriter::addMetricsTable( StreamData* streamData, const Drawing* dra
       metricData.append( (uchar) metric.units );
       metricData.append( encodeFloat( metric.resolution ) );
 
-      // Write how much data is there
-      metricData.prepend( encodeUInt( metricData.size() ) );
-
-      // Write the property ID
-      metricData.prepend( encodeUInt( property ) );
-
-      // Flush the metric
+      // Flush the metric: property ID, how much data is there, then the data
+      metricBlockData.append( encodeUInt( property ) );
+      metricBlockData.append( encodeUInt( metricData.size() ) );
       metricBlockData.append( metricData );
       metricData.clear();
     }
@@ -310,11 +313,11 @@ IsfError TagsWriter::addMetricsTable( StreamData* streamData, const Drawing* dra
 
   if( streamData->metrics.count() > 1 )
   {
-    tagData.prepend( encodeUInt( TAG_METRIC_TABLE ) );
+    encodeUInt( streamData->dataSource, TAG_METRIC_TABLE );
   }
   else if ( streamData->metrics.count() == 1 )
   {
-    tagData.prepend( encodeUInt( TAG_METRIC_BLOCK ) );
+    encodeUInt( streamData->dataSource, TAG_METRIC_BLOCK );
   }
   // else: don't do anything.
 
@@ -449,8 +452,7 @@ IsfError TagsWriter::addTransformationTable( StreamData* streamData, const Drawi
 #endif
     }
 
-    blockData.prepend( encodeUInt( transformTag ) );
-
+    tagContents.append( encodeUInt( transformTag ) );
     tagContents.append( blockData );
     blockData.clear();
 
@@ -476,8 +478,8 @@ IsfError TagsWriter::addTransformationTable( StreamData* streamData, const Drawi
   }
   else if ( streamData->transforms.size() > 1 )
   {
-    tagContents.prepend( encodeUInt( tagContents.size() ) );
-    tagContents.prepend( encodeUInt( TAG_TRANSFORM_TABLE ) );
+    encodeUInt( streamData->dataSource, TAG_TRANSFORM_TABLE );
+    encodeUInt( streamData->dataSource, tagContents.size() );
   }
 
   streamData->dataSource->append( tagContents );
@@ -488,29 +490,59 @@ IsfError TagsWriter::addTransformationTable( StreamData* streamData, const Drawi
 
 
 /**
- * Write the strokes.
+ * Compress the strokes and prepare their tags.
+ *
+ * The tags are kept in the stream data until addStrokes() writes them, so
+ * that the size of the whole stream is known before writing it.
  *
  * @param source Data Source where to write bytes to
  * @param drawing Drawing from which to obtain the data to write
  * @return IsfError
  */
-IsfError TagsWriter::addStrokes( StreamData* streamData, const Drawing* drawing )
+IsfError TagsWriter::prepareStrokes( StreamData* streamData, const Drawing* drawing )
 {
   QByteArray blockData;
-  QByteArray tagContents;
 
 #ifdef ISFQT_DEBUG_VERBOSE
-  qDebug() << "- Adding" << drawing->strokes_.count() << "strokes...";
+  qDebug() << "- Preparing" << drawing->d_->strokes.count() << "strokes...";
   quint8 counter = 0;
 #endif
 
+  const QList<Stroke*>&  strokes = drawing->d_->strokes;
+  const CompressionLevel level   = streamData->compressionLevel;
+
+  // Compress the points of all strokes first. Each stroke is independent from
+  // the others, so big drawings get their strokes compressed by multiple
+  // threads at once. Each stroke takes two pieces: its tags, then its points
+  QVector<QByteArray>& strokesData = streamData->strokesData;
+  strokesData.fill( QByteArray(), strokes.count() * 2 );
+  QByteArray*          output      = strokesData.data();
+  QAtomicInt           nextIndex( 0 );
+
+  quint64 totalPoints = 0;
+  foreach( Stroke* stroke, strokes )
+  {
+    totalPoints += stroke->pointCount();
+  }
+
+  runInParallel( [&]()
+  {
+    int index;
+    while( ( index = nextIndex.fetchAndAddRelaxed( 1 ) ) < strokes.count() )
+    {
+      output[ index * 2 + 1 ] = deflateStroke( strokes.at( index ), level );
+    }
+  }, 1 + (int)qMin( totalPoints / PARALLEL_STROKES_MIN_POINTS, (quint64)strokes.count() ) );
+
   // Last set of attibutes applied to a stroke
   AttributeSet   currentAttributeSet;
   const Metrics* currentMetrics   = 0;
   const QMatrix* currentTransform = 0;
 
-  foreach( Stroke* stroke, drawing->strokes_ )
+  for( int strokeIndex = 0; strokeIndex < strokes.count(); ++strokeIndex )
   {
+    const Stroke* stroke = strokes.at( strokeIndex );
+
     // There is more than one set of metrics, assign each stroke to its own
     if( streamData->metrics.count() > 1 )
     {
@@ -566,46 +598,89 @@ IsfError TagsWriter::addStrokes( StreamData* streamData, const Drawing* drawing
       }
     }
 
-    // Flush the index tags
-    if( ! blockData.isEmpty() )
-    {
-      tagContents.append( blockData );
-      blockData.clear();
-    }
+    // After the index tags, the stroke is made by tag, then payload size, then
+    // number of points, then the compressed points data
+    const QByteArray  numPoints( encodeUInt( stroke->pointCount() ) );
+    const QByteArray& pointsData = strokesData.at( strokeIndex * 2 + 1 );
 
-    // Write this stroke in the stream
+    blockData.append( encodeUInt( TAG_STROKE ) );
+    blockData.append( encodeUInt( numPoints.size() + pointsData.size() ) );
+    blockData.append( numPoints );
 
-    QList<qint64> xPoints, yPoints;
-    foreach( const Point& point, stroke->points() )
-    {
-      xPoints.append( point.position.x() );
-      yPoints.append( point.position.y() );
-    }
+    strokesData[ strokeIndex * 2 ] = blockData;
+    blockData.clear();
 
-    deflatePacketData( blockData, xPoints );
-    deflatePacketData( blockData, yPoints );
+#ifdef ISFQT_DEBUG_VERBOSE
+    qDebug() << "- Prepared stroke #" << ++counter;
+#endif
+  }
 
-    // The stroke is made by tag, then payload size, then number of points, then
-    // the compressed points data
-    blockData.prepend( encodeUInt( stroke->points().count() ) );
-    blockData.prepend( encodeUInt( blockData.size() ) );
-    blockData.prepend( encodeUInt( TAG_STROKE ) );
+  return ISF_ERROR_NONE;
+}
 
-    tagContents.append( blockData );
-    blockData.clear();
+
+
+/**
+ * Write the strokes prepared by prepareStrokes().
+ *
+ * @param source Data Source where to write bytes to
+ * @param drawing Drawing from which to obtain the data to write
+ * @return IsfError
+ */
+IsfError TagsWriter::addStrokes( StreamData* streamData, const Drawing* drawing )
+{
+  Q_UNUSED( drawing );
 
 #ifdef ISFQT_DEBUG_VERBOSE
-    qDebug() << "- Added stroke #" << ++counter;
+  qDebug() << "- Adding" << drawing->d_->strokes.count() << "strokes...";
 #endif
+
+  foreach( const QByteArray& data, streamData->strokesData )
+  {
+    streamData->dataSource->append( data );
   }
 
-  streamData->dataSource->append( tagContents );
+  streamData->strokesData.clear();
 
   return ISF_ERROR_NONE;
 }
 
 
 
+/**
+ * Compress the points of a stroke.
+ *
+ * This may be called by multiple threads at once, for different strokes.
+ *
+ * @param stroke The stroke to compress
+ * @param level How hard to try to make the data smaller
+ * @return The compressed X coordinates, followed by the Y coordinates
+ */
+QByteArray TagsWriter::deflateStroke( const Stroke* stroke, CompressionLevel level )
+{
+  QByteArray data;
+
+  const QVector<qint32>& xPositions = stroke->xPositions();
+  const QVector<qint32>& yPositions = stroke->yPositions();
+
+  QList<qint64> xPoints, yPoints;
+  xPoints.reserve( xPositions.size() );
+  yPoints.reserve( yPositions.size() );
+
+  for( int index = 0; index < xPositions.size(); ++index )
+  {
+    xPoints.append( xPositions[ index ] );
+    yPoints.append( yPositions[ index ] );
+  }
+
+  deflatePacketData( data, xPoints, level );
+  deflatePacketData( data, yPoints, level );
+
+  return data;
+}
+
+
+
 /**
  * Prepare the stream data for writing.
  *
@@ -623,12 +698,15 @@ IsfError TagsWriter::prepare( StreamData* streamData, const Drawing* drawing )
   streamData->metrics.clear();
   streamData->transforms.clear();
 
+  // Strokes loaded lazily need their points now
+  drawing->d_->inflate();
+
 #ifdef ISFQT_DEBUG_VERBOSE
-  qDebug() << "  - " << drawing->strokes_.count() << "strokes to optimize";
+  qDebug() << "  - " << drawing->d_->strokes.count() << "strokes to optimize";
 #endif
 
   // Prepare the list of attributes
-  foreach( Stroke* stroke, drawing->strokes_ )
+  foreach( Stroke* stroke, drawing->d_->strokes )
   {
     AttributeSet set;
     set.color   = stroke->color();
@@ -39,6 +39,7 @@ namespace Isf
   }
   using Compress::DataSource;
   class Drawing;
+  class Stroke;
 
 
 
@@ -57,6 +58,10 @@ namespace Isf
       static IsfError addTransformationTable( StreamData* streamData, const Drawing* drawing );
       static IsfError addStrokes( StreamData* streamData, const Drawing* drawing );
       static IsfError prepare( StreamData* streamData, const Drawing* drawing );
+      static IsfError prepareStrokes( StreamData* streamData, const Drawing* drawing );
+
+    private: // Static private methods
+      static QByteArray deflateStroke( const Stroke* stroke, CompressionLevel level );
   };
 }
 
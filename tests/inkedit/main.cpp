@@ -133,7 +133,7 @@ void TestInkEdit::loadInk()
     file.close();
 
     // got some ink.
-    Isf::Drawing *drawing = &Isf::Stream::reader(data);
+    Isf::Drawing *drawing = new Isf::Drawing( Isf::Stream::reader( data ) );
 
     editor_->setDrawing( drawing );
 
@@ -15,6 +15,7 @@
 
 #include "test_algorithms.h"
 
+#include "data/compression.h"
 #include "data/datasource.h"
 #include "data/multibytecoding.h"
 
@@ -45,6 +46,56 @@ void TestAlgorithms::testDataSource()
 
 
 
+void TestAlgorithms::testPropertyBitPacking()
+{
+  QList<qint64> bytes;
+  bytes << 3 << 0 << 27 << 253 << 255 << 255;
+
+  QList<qint64> smallBytes;
+  smallBytes << 1 << 0 << 1 << 1 << 0;
+
+  QList<qint64> words;
+  words << 3 << 0 << 270 << 65535;
+
+  QList<qint64> longs;
+  longs << -70000 << 0 << 1 << 65536 << -1 << 2147483647;
+
+  foreach( const QList<qint64>& source, QList< QList<qint64> >() << bytes << smallBytes << words << longs )
+  {
+    QByteArray encoded;
+    QVERIFY( deflatePropertyData( encoded, source ) );
+
+    DataSource data( encoded );
+    QList<qint64> decoded;
+    QVERIFY( inflatePropertyData( &data, encoded.size() - 1, decoded ) );
+    QCOMPARE( decoded, source );
+  }
+}
+
+
+
+void TestAlgorithms::testPropertyLimpelZiv()
+{
+  // A repetitive blob, longer than the compression window
+  QList<qint64> blob;
+  for( int i = 0; i < 10000; ++i )
+  {
+    blob << ( ( i * 7 ) % 31 ) << ( i % 13 ) << 0x41;
+  }
+
+  QByteArray encoded;
+  QVERIFY( deflatePropertyData( encoded, blob ) );
+  QCOMPARE( (quint8)encoded.at( 0 ), (quint8)LimpelZiv );
+  QVERIFY( encoded.size() < blob.count() );
+
+  DataSource data( encoded );
+  QList<qint64> decoded;
+  QVERIFY( inflatePropertyData( &data, encoded.size() - 1, decoded ) );
+  QCOMPARE( decoded, blob );
+}
+
+
+
 QTEST_MAIN(TestAlgorithms)
 
 
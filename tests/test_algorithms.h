@@ -25,6 +25,8 @@ class TestAlgorithms : public QObject
 Q_OBJECT
 private slots:
     void testDataSource();
+    void testPropertyBitPacking();
+    void testPropertyLimpelZiv();
 };
 
 #endif // TESTALGORITHMS_H
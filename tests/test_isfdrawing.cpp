@@ -23,6 +23,7 @@
 #include <QtTest/QtTest>
 
 #include <IsfQtDrawing>
+#include <IsfQtStroke>
 
 using namespace Isf;
 
@@ -101,7 +102,7 @@ void TestIsfDrawing::createDrawing()
   QCOMPARE( drawing1.isNull(), false );
 
   qDebug() << "------------------------- Writing drawing to ISF file -------------------------";
-  QByteArray data2( Isf::Stream::writer( drawing1 ) );
+  QByteArray data2( Isf::Stream::writer( drawing1, false, Isf::CompressionFast ) );
 
   qDebug() << "------------------------- Reading it back -------------------------";
   Isf::Drawing drawing2 = Isf::Stream::reader( data2 );
@@ -110,6 +111,419 @@ void TestIsfDrawing::createDrawing()
 
   qDebug() << "Streams size - data1:" << data1.size() << "data2:" << data2.size();
   QVERIFY( data1.size() == data2.size() );
+
+  qDebug() << "------------------------- Writing it with the best compression -------------------------";
+  QByteArray data3( Isf::Stream::writer( drawing1, false, Isf::CompressionBest ) );
+  Isf::Drawing drawing3 = Isf::Stream::reader( data3 );
+
+  QCOMPARE( drawing3.isNull(), false );
+  QCOMPARE( drawing3.strokes().count(), drawing1.strokes().count() );
+
+  qDebug() << "Streams size - data2:" << data2.size() << "data3:" << data3.size();
+  QVERIFY( data3.size() <= data2.size() );
+}
+
+
+
+// decoders and encoders can be used again and again
+void TestIsfDrawing::reuseCodecs()
+{
+  QByteArray data;
+  readTestIsfData( "tests/test4.isf", data );
+
+  Isf::Decoder decoder;
+  Isf::Drawing drawing1 = decoder.decode( data );
+  Isf::Drawing drawing2 = decoder.decode( data );
+
+  QCOMPARE( drawing1.isNull(), false );
+  QCOMPARE( drawing2.strokes().count(), drawing1.strokes().count() );
+
+  Isf::Encoder encoder;
+  const QByteArray encoded( encoder.encode( drawing1 ) );
+
+  QVERIFY( ! encoded.isEmpty() );
+  QCOMPARE( encoder.encode( drawing2 ), encoded );
+  QCOMPARE( Isf::Stream::writer( drawing1 ), encoded );
+}
+
+
+
+// batches of streams are decoded in the same order
+void TestIsfDrawing::batchDecode()
+{
+  QByteArray data1;
+  readTestIsfData( "tests/test4.isf", data1 );
+  const QByteArray data2( Isf::Stream::writer( Isf::Stream::reader( data1 ), false, Isf::CompressionFast ) );
+
+  QList<QByteArray> streams;
+  for( int i = 0; i < 20; ++i )
+  {
+    streams << data1 << QByteArray( "invalid" ) << data2;
+  }
+
+  const QList<Isf::Drawing> drawings( Isf::Stream::readerBatch( streams ) );
+  const int strokeCount = Isf::Stream::reader( data1 ).strokes().count();
+
+  QCOMPARE( drawings.count(), streams.count() );
+  for( int i = 0; i < drawings.count(); i += 3 )
+  {
+    QCOMPARE( drawings[ i ].error(), Isf::ISF_ERROR_NONE );
+    QCOMPARE( drawings[ i ].isNull(), false );
+    QCOMPARE( drawings[ i + 1 ].isNull(), true );
+    QVERIFY( drawings[ i + 1 ].error() != Isf::ISF_ERROR_NONE );
+    QCOMPARE( Isf::Drawing( drawings[ i + 2 ] ).strokes().count(), strokeCount );
+  }
+}
+
+
+
+// streams fed in pieces give out their strokes as soon as they arrive
+void TestIsfDrawing::incrementalDecode()
+{
+  QByteArray data;
+  readTestIsfData( "tests/test4.isf", data );
+  Isf::Drawing expected = Isf::Stream::reader( data );
+
+  Isf::IncrementalDecoder decoder;
+  QSignalSpy strokeSpy( &decoder, SIGNAL(strokeDecoded(int)) );
+  QSignalSpy finishedSpy( &decoder, SIGNAL(finished(Isf::IsfError)) );
+
+  // Feed one byte at a time
+  int fed = 0;
+  while( fed < data.size() && strokeSpy.isEmpty() )
+  {
+    decoder.feed( data.mid( fed++, 1 ) );
+  }
+
+  QCOMPARE( strokeSpy.count(), 1 );
+  QCOMPARE( strokeSpy.at( 0 ).at( 0 ).toInt(), 0 );
+  QVERIFY( fed < data.size() );
+  QCOMPARE( decoder.isFinished(), false );
+
+  while( fed < data.size() )
+  {
+    decoder.feed( data.mid( fed++, 1 ) );
+  }
+
+  QCOMPARE( decoder.isFinished(), true );
+  QCOMPARE( finishedSpy.count(), 1 );
+  QCOMPARE( decoder.error(), Isf::ISF_ERROR_NONE );
+  QCOMPARE( strokeSpy.count(), expected.strokes().count() );
+
+  Isf::Drawing drawing( decoder.drawing() );
+  QCOMPARE( drawing.boundingRect(), expected.boundingRect() );
+  for( int i = 0; i < expected.strokes().count(); ++i )
+  {
+    QCOMPARE( drawing.stroke( i )->xPositions(), expected.stroke( i )->xPositions() );
+    QCOMPARE( drawing.stroke( i )->yPositions(), expected.stroke( i )->yPositions() );
+  }
+
+  // Invalid streams stop the decoder
+  decoder.reset();
+  decoder.feed( QByteArray( 1, 0x0B ) );
+  QCOMPARE( decoder.isFinished(), true );
+  QCOMPARE( decoder.error(), Isf::ISF_ERROR_BAD_VERSION );
+}
+
+
+
+// drawings can be written to and read from devices
+void TestIsfDrawing::deviceStreams()
+{
+  QByteArray data;
+  readTestIsfData( "tests/test4.isf", data );
+  Isf::Drawing drawing = Isf::Stream::reader( data );
+
+  for( int base64 = 0; base64 < 2; ++base64 )
+  {
+    QBuffer buffer;
+    QVERIFY( buffer.open( QIODevice::ReadWrite ) );
+    QVERIFY( Isf::Stream::writer( drawing, buffer, base64 ) );
+    QCOMPARE( buffer.data(), Isf::Stream::writer( drawing, base64 ) );
+    buffer.write( "trailer" );
+
+    // Only the stream is read, the rest is left in the device
+    buffer.seek( 0 );
+    Isf::Drawing readBack = Isf::Stream::reader( buffer, base64 );
+    QCOMPARE( readBack.error(), Isf::ISF_ERROR_NONE );
+    QCOMPARE( readBack.strokes().count(), drawing.strokes().count() );
+    QCOMPARE( readBack.boundingRect(), drawing.boundingRect() );
+    QCOMPARE( buffer.readAll(), QByteArray( "trailer" ) );
+  }
+
+  // Files are read in place; whatever follows the stream is left alone
+  QTemporaryFile file;
+  QVERIFY( file.open() );
+  QVERIFY( Isf::Stream::writer( drawing, file ) );
+  file.write( "trailer" );
+  file.seek( 0 );
+
+  Isf::Drawing fromFile = Isf::Stream::reader( file );
+  QCOMPARE( fromFile.error(), Isf::ISF_ERROR_NONE );
+  QCOMPARE( fromFile.strokes().count(), drawing.strokes().count() );
+  QCOMPARE( file.readAll(), QByteArray( "trailer" ) );
+
+  // Devices which end before the stream does give a null drawing
+  QBuffer truncated;
+  truncated.setData( data.left( data.size() - 10 ) );
+  QVERIFY( truncated.open( QIODevice::ReadOnly ) );
+
+  Isf::Drawing broken = Isf::Stream::reader( truncated );
+  QCOMPARE( broken.isNull(), true );
+  QCOMPARE( broken.error(), Isf::ISF_ERROR_BAD_STREAMSIZE );
+}
+
+
+
+// streams are encoded to and decoded from Base64 on the fly
+void TestIsfDrawing::base64Streams()
+{
+  QByteArray data;
+  readTestIsfData( "tests/test4.isf", data );
+  Isf::Drawing drawing = Isf::Stream::reader( data );
+
+  const QByteArray encoded( Isf::Stream::writer( drawing, true ) );
+  QCOMPARE( encoded, Isf::Stream::writer( drawing ).toBase64() );
+
+  // Line breaks, like in MIME or JSON transports, are skipped
+  QByteArray wrapped;
+  for( int pos = 0; pos < encoded.size(); pos += 76 )
+  {
+    wrapped.append( encoded.mid( pos, 76 ) );
+    wrapped.append( "\r\n" );
+  }
+
+  Isf::Drawing readBack = Isf::Stream::reader( wrapped, true );
+  QCOMPARE( readBack.error(), Isf::ISF_ERROR_NONE );
+  QCOMPARE( readBack.strokes().count(), drawing.strokes().count() );
+  QCOMPARE( Isf::Stream::writer( readBack ), Isf::Stream::writer( drawing ) );
+
+  QBuffer buffer( &wrapped );
+  QVERIFY( buffer.open( QIODevice::ReadOnly ) );
+  Isf::Drawing fromDevice = Isf::Stream::reader( buffer, true );
+  QCOMPARE( fromDevice.error(), Isf::ISF_ERROR_NONE );
+  QCOMPARE( Isf::Stream::writer( fromDevice ), Isf::Stream::writer( drawing ) );
+}
+
+
+
+// lazily loaded drawings give the same strokes when they're needed
+void TestIsfDrawing::lazyLoading()
+{
+  QByteArray data;
+  readTestIsfData( "tests/test4.isf", data );
+  Isf::Drawing eager = Isf::Stream::reader( data );
+
+  Isf::Decoder decoder;
+  decoder.setLazyLoading( true );
+  QCOMPARE( decoder.lazyLoading(), true );
+
+  Isf::Drawing lazy = decoder.decode( data );
+  QCOMPARE( lazy.error(), Isf::ISF_ERROR_NONE );
+  QCOMPARE( lazy.strokeCount(), eager.strokeCount() );
+
+  // A single stroke is decompressed when it's retrieved
+  QCOMPARE( lazy.stroke( 1 )->xPositions(), eager.stroke( 1 )->xPositions() );
+  QCOMPARE( lazy.stroke( 1 )->yPositions(), eager.stroke( 1 )->yPositions() );
+
+  // Copies decompress the rest on their own
+  Isf::Drawing copy( lazy );
+  copy.stroke( 0 )->setColor( Qt::red );
+  QCOMPARE( copy.stroke( 2 )->xPositions(), eager.stroke( 2 )->xPositions() );
+
+  QCOMPARE( lazy.boundingRect(), eager.boundingRect() );
+  for( int i = 0; i < eager.strokeCount(); ++i )
+  {
+    QCOMPARE( lazy.stroke( i )->xPositions(), eager.stroke( i )->xPositions() );
+  }
+  QCOMPARE( Isf::Stream::writer( lazy ), Isf::Stream::writer( eager ) );
+}
+
+
+
+// decoded drawings have the bounding rect they would compute themselves
+void TestIsfDrawing::readerBoundingRect()
+{
+  QStringList files;
+  files << "tests/test1.isf" << "tests/test4.isf";
+
+  foreach( const QString& file, files )
+  {
+    QByteArray data;
+    readTestIsfData( file, data );
+
+    Isf::Decoder decoder;
+    for( int lazy = 0; lazy < 2; ++lazy )
+    {
+      decoder.setLazyLoading( lazy );
+
+      Isf::Drawing drawing = decoder.decode( data );
+      QCOMPARE( drawing.error(), Isf::ISF_ERROR_NONE );
+
+      QRect expected( drawing.boundingRect() );
+      drawing.updateBoundingRect();
+      QCOMPARE( drawing.boundingRect(), expected );
+    }
+  }
+}
+
+
+
+// big drawings have their strokes encoded and decoded in parallel
+void TestIsfDrawing::largeDrawing()
+{
+  Isf::Drawing drawing;
+  quint32 seed = 1;
+  for( int i = 0; i < 400; ++i )
+  {
+    PointList points;
+    for( int j = 0; j < 500; ++j )
+    {
+      seed = seed * 1103515245 + 12345;
+      points << Point( QPoint( ( seed >> 8 ) % 2000, ( seed >> 16 ) % 1500 ) );
+    }
+    drawing.addStroke( points );
+  }
+
+  const QByteArray data( Isf::Stream::writer( drawing ) );
+  Isf::Drawing decoded = Isf::Stream::reader( data );
+
+  QCOMPARE( decoded.error(), Isf::ISF_ERROR_NONE );
+  QCOMPARE( decoded.strokes().count(), drawing.strokes().count() );
+  for( int i = 0; i < drawing.strokes().count(); ++i )
+  {
+    QCOMPARE( decoded.stroke( i )->xPositions(), drawing.stroke( i )->xPositions() );
+    QCOMPARE( decoded.stroke( i )->yPositions(), drawing.stroke( i )->yPositions() );
+  }
+
+  // The strokes are compressed in parallel, but always to the same bytes
+  QCOMPARE( Isf::Stream::writer( decoded ), data );
+}
+
+
+
+// points added to a stroke should be read back unchanged
+void TestIsfDrawing::strokePoints()
+{
+  PointList points;
+  points << Point( QPoint( 10, 20 ) )
+         << Point( QPoint( -5, 7 ) );
+
+  Stroke stroke;
+  stroke.addPoints( points );
+
+  QCOMPARE( stroke.pointCount(), 2 );
+  QCOMPARE( stroke.hasPressureData(), false );
+  QVERIFY( stroke.pressureLevels().isEmpty() );
+
+  // Adding pressure gives the earlier points a zero pressure level
+  stroke.addPoint( Point( QPoint( 3, 4 ), 100 ) );
+  points << Point( QPoint( 3, 4 ), 100 );
+
+  QCOMPARE( stroke.pointCount(), 3 );
+  QCOMPARE( stroke.hasPressureData(), true );
+  QCOMPARE( stroke.xPositions(), QVector<qint32>() << 10 << -5 << 3 );
+  QCOMPARE( stroke.yPositions(), QVector<qint32>() << 20 << 7 << 4 );
+  QCOMPARE( stroke.pressureLevels(), QVector<qint64>() << 0 << 0 << 100 );
+
+  const PointList strokePoints( stroke.points() );
+  QCOMPARE( strokePoints.count(), points.count() );
+  for( int i = 0; i < points.count(); ++i )
+  {
+    QCOMPARE( strokePoints[ i ].position, points[ i ].position );
+    QCOMPARE( strokePoints[ i ].pressureLevel, points[ i ].pressureLevel );
+  }
+
+  // The bounding rect includes the pen size
+  stroke.setPenSize( QSizeF( 2, 2 ) );
+  stroke.finalize();
+  QCOMPARE( stroke.boundingRect(), QRect( QPoint( -6, 3 ), QPoint( 11, 21 ) ) );
+}
+
+
+
+void TestIsfDrawing::implicitSharing()
+{
+  Stroke stroke;
+  stroke.addPoint( Point( QPoint( 1, 2 ) ) );
+
+  // Changing a copy of a stroke leaves the original alone
+  Stroke strokeCopy( stroke );
+  strokeCopy.addPoint( Point( QPoint( 3, 4 ) ) );
+  QCOMPARE( stroke.pointCount(), 1 );
+  QCOMPARE( strokeCopy.pointCount(), 2 );
+
+  Drawing drawing;
+  drawing.addStroke( PointList() << Point( QPoint( 0, 0 ) ) << Point( QPoint( 10, 10 ) ) );
+
+  // Changing a copy of a drawing leaves the original alone
+  Drawing drawingCopy( drawing );
+  QCOMPARE( drawingCopy.strokes().count(), 1 );
+
+  drawingCopy.addStroke( PointList() << Point( QPoint( 20, 20 ) ) );
+  drawingCopy.stroke( 0 )->setColor( Qt::red );
+  QCOMPARE( drawingCopy.strokes().count(), 2 );
+  QCOMPARE( drawing.strokes().count(), 1 );
+  QVERIFY( drawing.stroke( 0 ) != drawingCopy.stroke( 0 ) );
+  QVERIFY( drawing.stroke( 0 )->color() != drawingCopy.stroke( 0 )->color() );
+  QCOMPARE( drawing.stroke( 0 )->xPositions(), drawingCopy.stroke( 0 )->xPositions() );
+
+  // Clearing a copy leaves the original alone as well
+  Drawing otherCopy;
+  otherCopy = drawing;
+  otherCopy.clear();
+  QVERIFY( otherCopy.isNull() );
+  QCOMPARE( drawing.strokes().count(), 1 );
+
+  // Strokes copied out of a decoded drawing keep its metrics alive
+  QByteArray data;
+  readTestIsfData( "tests/test4.isf", data );
+
+  Drawing* decoded = new Drawing( Stream::reader( data ) );
+  QVERIFY( ! decoded->isNull() );
+  QVERIFY( decoded->stroke( 0 )->metrics() != 0 );
+
+  Stroke decodedCopy( *decoded->stroke( 0 ) );
+  int metricsCount = decoded->stroke( 0 )->metrics()->items.count();
+  delete decoded;
+
+  QCOMPARE( decodedCopy.metrics()->items.count(), metricsCount );
+}
+
+
+
+void TestIsfDrawing::moveSemantics()
+{
+  Drawing drawing;
+  drawing.addStroke( PointList() << Point( QPoint( 0, 0 ) ) << Point( QPoint( 10, 10 ) ) );
+  Stroke* stroke = drawing.stroke( 0 );
+
+  // Moving a drawing keeps the very same strokes
+  Drawing moved( std::move( drawing ) );
+  QCOMPARE( moved.strokes().count(), 1 );
+  QCOMPARE( moved.stroke( 0 ), stroke );
+
+  // The moved-from drawing is left empty, and can still be used
+  QVERIFY( drawing.isNull() );
+  QCOMPARE( drawing.strokes().count(), 0 );
+  QCOMPARE( drawing.addStroke( PointList() << Point( QPoint( 5, 5 ) ) ), 0 );
+
+  Drawing other;
+  other = std::move( moved );
+  QCOMPARE( other.stroke( 0 ), stroke );
+  QVERIFY( moved.isNull() );
+
+  Stroke source;
+  source.addPoint( Point( QPoint( 1, 2 ) ) );
+
+  Stroke movedStroke( std::move( source ) );
+  QCOMPARE( movedStroke.pointCount(), 1 );
+
+  // The moved-from stroke is left empty, and can still be used
+  QCOMPARE( source.pointCount(), 0 );
+  source.addPoint( Point( QPoint( 3, 4 ) ) );
+  QCOMPARE( source.pointCount(), 1 );
+  QCOMPARE( movedStroke.pointCount(), 1 );
 }
 
 
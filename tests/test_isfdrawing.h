@@ -33,6 +33,17 @@ Q_OBJECT
     void parseValidRawIsfData();
 
     void createDrawing();
+    void reuseCodecs();
+    void batchDecode();
+    void incrementalDecode();
+    void deviceStreams();
+    void base64Streams();
+    void lazyLoading();
+    void readerBoundingRect();
+    void largeDrawing();
+    void strokePoints();
+    void implicitSharing();
+    void moveSemantics();
   private:
 
 };